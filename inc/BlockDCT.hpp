@@ -0,0 +1,67 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ 8x8 block DCT of a strip of 8 rows.
+
+ All the blocks of the strip are transformed at once with a separable DCT:
+ both passes run down the columns of the whole strip (with a transposition
+ of each block in between), so that the inner loops span the image width.
+ The variances used by the PSNR-HVS-M masking are computed from the same
+ strip.
+
+**************************************************************************/
+
+#ifndef BlockDCT_hpp
+#define BlockDCT_hpp
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+class BlockDCT {
+public:
+	explicit BlockDCT(int width);
+	// Compute the DCT of the 8x8 blocks in rows [y,y+8) of img (CV_32F)
+	void transform(const cv::Mat& img, int y);
+	// Number of blocks in a strip
+	int blocks() const;
+	// Coefficients of column l of all blocks, coefficient (k,l) of block b being at index 8*b+k
+	const float* row(int l) const;
+	// Variance times number of samples of each block (see PSNRHVS::vari)
+	const float* variance() const;
+	// Sum of the variances times number of samples of the four 4x4 quadrants of each block
+	const float* quadrantVariance() const;
+private:
+	int width;
+	int nblocks;
+	float basis[8][8];		// DCT-II basis, basis[k][i] = c(k)*cos((2i+1)k*pi/16)
+	std::vector<float> coefs;	// transposed coefficients, 8 rows of width samples
+	std::vector<float> tmp;		// intermediate rows, 8 rows of width samples
+	std::vector<float> sums;	// sums and sums of squares of the half rows of the quadrants
+	std::vector<float> var;
+	std::vector<float> qvar;
+};
+
+#endif
@@ -0,0 +1,137 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Set of metric instances computing all the requested quality indexes of
+ one frame pair.
+
+ An Evaluator is not thread-safe: each thread needs its own instance.
+
+**************************************************************************/
+
+#ifndef Evaluator_hpp
+#define Evaluator_hpp
+
+#include <opencv2/core/core.hpp>
+#include "PSNR.hpp"
+#include "SSIM.hpp"
+#include "MSSSIM.hpp"
+#include "VIFP.hpp"
+#include "PSNRHVS.hpp"
+#include "Profile.hpp"
+
+enum Metrics {
+	METRIC_PSNR = 0,
+	METRIC_SSIM,
+	METRIC_MSSSIM,
+	METRIC_VIFP,
+	METRIC_PSNRHVS,
+	METRIC_PSNRHVSM,
+	METRIC_SIZE
+};
+
+// Per-block quality maps of the frames
+enum Maps {
+	MAP_SSIM = 0,	// means of the SSIM map over blocks of 16x16 windows
+	MAP_PSNRHVSM,	// PSNR-HVS-M errors of the 8x8 blocks
+	MAP_SIZE
+};
+
+// Blocks of 'block' x 'block' samples, 'rows' x 'cols' values in row-major order
+// A map that is not computed has no rows
+struct MapLayout {
+	int block;
+	int rows;
+	int cols;
+};
+
+class Evaluator {
+public:
+	// Only the metrics flagged in 'metrics' are instantiated and computed
+	// Frames have 'bitdepth' bits per sample (CV_8U up to 8 bits, CV_16U above)
+	Evaluator(int height, int width, const bool metrics[METRIC_SIZE], int bitdepth = 8);
+	~Evaluator();
+	// Compute the requested quality indexes of the processed frame
+	// When the processed frame is identical to the original, only VIFp is computed, the other
+	// quality indexes and the maps being known (e.g. infinite PSNR and SSIM of 1)
+	// Entries of 'result' for metrics that are not requested are left untouched
+	// The maps of the requested metrics are written one after the other to 'maps'
+	// (getMapSize() values), unless it is NULL
+	void compute(const cv::Mat& original, const cv::Mat& processed, float result[METRIC_SIZE], float *maps = NULL);
+	// Compute the statistics of the original frame that are shared by the
+	// following calls to compare(), when several processed frames share the same original
+	// The original frame needs to stay unchanged until the last call to compare()
+	void setReference(const cv::Mat& original);
+	// Same as compute(), against the original frame given to setReference()
+	void compare(const cv::Mat& processed, float result[METRIC_SIZE], float *maps = NULL);
+	// Compute each frame in bands of rows over the workers of 'pool', NULL to compute it on the
+	// calling thread only (see Metric::setPool())
+	void setPool(ThreadPool *pool);
+	// Layout of the maps of the requested metrics
+	void getMapLayout(MapLayout layout[MAP_SIZE]) const;
+	// Number of values of all the maps
+	int getMapSize() const;
+	// Add the time taken by the conversion and by each metric to 'total', as well as
+	// the number of buffers the metrics allocated after the first frame
+	void getProfile(Profile& total) const;
+	// Check that the metrics can be computed on frames of the given dimensions
+	// Returns NULL if they can, or an error message otherwise
+	static const char* checkSize(int height, int width, const bool metrics[METRIC_SIZE]);
+private:
+	bool enabled[METRIC_SIZE];
+	bool needs_float;		// at least one metric works on floating-point frames
+	double scale;			// scaling of the samples to the 8-bit range
+	cv::Mat original_frame;		// original frame converted to CV_32F
+	cv::Mat processed_frame;	// processed frame converted to CV_32F
+	cv::Mat reference;		// original frame given to setReference()
+	PSNR *psnr;
+	SSIM *ssim;
+	MSSSIM *msssim;
+	VIFP *vifp;
+	PSNRHVS *phvs;
+	ThreadPool *pool;		// pool computing the bands of rows, NULL if none
+	MapLayout map_layout[MAP_SIZE];
+	int map_offset[MAP_SIZE];	// position of each map in the buffer given to compute()
+	int map_size;
+	Profile profile;
+	int frames;			// frames started by compute() or setReference()
+	uint64_t warmup;		// buffers allocated by the first frame
+	// Start a new frame
+	void begin();
+	// Point the metrics to their maps in 'maps', or disable the maps if NULL
+	void setMaps(float *maps);
+	// Whether two frames have the same samples
+	static bool isIdentical(const cv::Mat& a, const cv::Mat& b);
+	// Set the quality indexes and maps that the metrics other than VIFp give on identical frames
+	void setIdentical(float result[METRIC_SIZE], float *maps);
+	// Convert a frame (CV_8U or CV_16U) to a scaled CV_32F frame of the same size
+	void convert(const cv::Mat& src, cv::Mat& dst) const;
+	// Number of buffers allocated by the metrics so far
+	uint64_t allocations() const;
+	Evaluator(const Evaluator&);
+	Evaluator& operator=(const Evaluator&);
+};
+
+#endif
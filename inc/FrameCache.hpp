@@ -0,0 +1,85 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Cache of the quality indexes of recent component pairs.
+
+ Broadcast content repeats frames (slates, freeze frames, black), which
+ give the same pairs of original and processed components over and over.
+ Each pair is identified by the fingerprints of its two components, 64-bit
+ hashes computed with the vectorized hash kernel, and the quality indexes
+ and maps of the last distinct pairs are kept, the least recently used one
+ being replaced.
+ Every lane of the kernel keeps 64 bits of state, so that components
+ differing in a small region (e.g. a clock on a freeze frame) are told
+ apart by 64 bits, as much as components differing everywhere. A hit is not
+ checked against the samples: two different pairs are mistaken for one
+ another with a probability of about 2^-128.
+
+ A FrameCache is thread-safe.
+
+**************************************************************************/
+
+#ifndef FrameCache_hpp
+#define FrameCache_hpp
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "Evaluator.hpp"
+
+class FrameCache {
+public:
+	// Keep the quality indexes of up to 'capacity' pairs, none if 0
+	explicit FrameCache(int capacity);
+	bool isEnabled() const;
+	// Number of map values of each pair (see Evaluator::getMapSize())
+	// Needs to be called before the first call to insert()
+	void setMapSize(int size);
+	// Copy the quality indexes and maps (unless 'maps' is NULL) of a pair, given the
+	// fingerprints of its components
+	// Returns false if the pair is not in the cache
+	bool find(uint64_t original, uint64_t processed, float result[METRIC_SIZE], float *maps);
+	// Add the quality indexes and maps of a pair, replacing the least recently used one
+	void insert(uint64_t original, uint64_t processed, const float result[METRIC_SIZE], const float *maps);
+	// Fingerprint of a component (CV_8U or CV_16U)
+	static uint64_t fingerprint(const cv::Mat& component);
+private:
+	struct Entry {
+		uint64_t original;
+		uint64_t processed;
+		uint64_t used;		// value of 'clock' when last used, 0 if the entry is empty
+		float result[METRIC_SIZE];
+		std::vector<float> maps;
+	};
+	std::vector<Entry> entries;
+	uint64_t clock;
+	std::mutex mutex;
+	FrameCache(const FrameCache&);
+	FrameCache& operator=(const FrameCache&);
+};
+
+#endif
@@ -0,0 +1,150 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Frame-parallel execution engine.
+
+ Frames are computed concurrently by a pool of workers, each owning its
+ own Evaluator for every component. The components of a frame are scheduled
+ as separate tasks. Each original frame can be compared to several processed
+ frames (e.g. the renditions of an encoding ladder): the statistics of the
+ original component are then computed once and shared by all comparisons.
+ The quality indexes of recent component pairs can be kept in a cache, to
+ skip the computation of repeated frames.
+ In intra mode, each component is also split into bands of rows computed
+ by all the workers, to lower the latency of each frame.
+ Processed frames can be skipped, e.g. once their video is rejected.
+ Results are handed to the writer in frame order, from the thread calling
+ acquire() or flush(), or in live mode from the worker finishing the frame,
+ along with the per-block maps of the luma component when requested.
+
+**************************************************************************/
+
+#ifndef FrameEngine_hpp
+#define FrameEngine_hpp
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "Evaluator.hpp"
+#include "FrameCache.hpp"
+#include "Profile.hpp"
+#include "ThreadPool.hpp"
+#include "VideoYUV.hpp"
+
+// One processed frame and its quality indexes
+struct ProcessedFrame {
+	cv::Mat component[PLANE_SIZE];		// processed components (CV_8U or CV_16U)
+	float result[PLANE_SIZE][METRIC_SIZE];	// quality indexes of each component
+	std::vector<float> maps;		// maps of the luma component, empty if not requested
+	uint64_t fingerprint[PLANE_SIZE];	// fingerprints of the components, with the cache
+	bool cached[PLANE_SIZE];		// quality indexes of the component found in the cache
+	bool skipped;				// neither computed nor written out (e.g. rejected video)
+};
+
+struct FrameSlot {
+	int frame;				// frame number
+	cv::Mat original[PLANE_SIZE];		// original components (CV_8U or CV_16U), which can point to
+						// samples of the caller that stay valid until the slot is done
+	std::vector<ProcessedFrame> processed;	// one for each processed video
+	int pending;				// number of components left to compute
+	double submitted;			// submission time
+	bool done;				// result is available
+};
+
+class FrameEngine {
+public:
+	// Called for each processed video of each frame
+	// 'maps' is NULL unless the maps have been requested with setMaps()
+	typedef std::function<void(int frame, int video, const float result[PLANE_SIZE][METRIC_SIZE],
+		const float *maps)> Writer;
+	// The first 'nbplanes' components, of the given dimensions and bit depth, are computed
+	// Each original frame is compared to 'nbvideos' processed frames
+	FrameEngine(const int height[PLANE_SIZE], const int width[PLANE_SIZE], int nbplanes, int bitdepth,
+		int nbvideos, const bool metrics[METRIC_SIZE], int nbthreads, const Writer& writer);
+	~FrameEngine();
+	// Get a free slot for the given frame
+	// Blocks (and writes out finished frames) while all slots are in flight
+	FrameSlot* acquire(int frame);
+	// Schedule the computation of a slot previously returned by acquire()
+	void submit(FrameSlot* slot);
+	// Write out the finished frames that are next in order, without waiting
+	void poll();
+	// In live mode, each frame is written out by the worker that finishes it, as soon as
+	// the previous frames have been written, rather than on the next call to acquire()
+	// The writer is then called from the workers, one call at a time
+	// Needs to be called before the first call to submit()
+	void setLive(bool enable);
+	// In intra mode, the bands of rows of each component are computed in parallel by all the
+	// workers (see Evaluator::setPool()), and at most two frames are in flight, each one
+	// computed by the Evaluators of its slot
+	// The results are the same as without intra mode
+	// Needs to be called before the first call to acquire()
+	void setIntra(bool enable);
+	// Compute the maps of the luma component (see Evaluator::compute())
+	// Needs to be called before the first call to acquire()
+	void setMaps(bool enable);
+	// Keep the quality indexes (and maps) of the last 'capacity' distinct pairs of original and
+	// processed components, to skip repeated ones (see FrameCache), none if 0 (default)
+	// Needs to be called before the first call to acquire()
+	void setCache(int capacity);
+	// Number of slots, i.e. of frames that can be in flight
+	int getDepth() const;
+	// Layout of the maps handed to the writer
+	void getMapLayout(MapLayout layout[MAP_SIZE]) const;
+	// Wait for all submitted frames and write them out
+	void flush();
+	// Add the timing of the computation to 'total'
+	// flush() needs to be called before getProfile()
+	void getProfile(Profile& total) const;
+private:
+	static const int INTRA_SLOTS = 2;	// frames in flight in intra mode
+	ThreadPool *pool;
+	int nbplanes;
+	std::vector<Evaluator*> evaluators[PLANE_SIZE];	// one per worker (per slot in intra mode) for each component
+	FrameCache *caches[PLANE_SIZE];			// one for each component
+	std::vector<FrameSlot> slots;
+	Writer writer;
+	long next_acquire;	// sequence number of the next acquired slot
+	long next_submit;	// sequence number of the next submitted slot, guarded by 'mutex'
+	long next_write;	// sequence number of the next slot to write out, guarded by 'writing'
+	bool live;		// slots are written out by the workers
+	bool intra;		// slots are computed in bands by all the workers, with their own Evaluators
+	std::mutex mutex;
+	std::mutex writing;	// held while slots are written out
+	std::condition_variable cond;
+	Profile profile;	// frame latency and slot waits, guarded by 'mutex'
+	// Write out finished slots in order until 'until' (excluded) has been reached
+	// Stops at the first unfinished slot if 'block' is false
+	void write(long until, bool block);
+	// Maps of the given component of a processed frame, NULL if not computed
+	static float* maps(ProcessedFrame& processed, int plane);
+	FrameEngine(const FrameEngine&);
+	FrameEngine& operator=(const FrameEngine&);
+};
+
+#endif
@@ -54,17 +54,41 @@ public:
 	// Compute the SSIM and MS-SSIM indexes of the processed image
 	// Return the MS-SSIM index
 	float compute(const cv::Mat& original, const cv::Mat& processed);
+	// Compute the pyramid and statistics of the original image that are shared
+	// by the following calls to compare()
+	// The original image needs to stay unchanged until the last call to compare()
+	void setReference(const cv::Mat& original);
+	// Compute the SSIM and MS-SSIM indexes of the processed image against the last reference
+	// Gives the same result as compute()
+	float compare(const cv::Mat& processed);
 	// Return the SSIM index only
 	// compute() needs to be called before getSSIM()
 	float getSSIM();
 	// Return the MS-SSIM index only
 	// compute() needs to be called before getMSSSIM()
 	float getMSSSIM();
+	// Pool the SSIM map of the first level (see SSIM::setMap())
+	using SSIM::setMap;
+	using SSIM::mapRows;
+	using SSIM::mapCols;
+	// Compute the bands of rows of all the levels in parallel (see Metric::setPool())
+	using SSIM::setPool;
+	using SSIM::getAllocations;
 private:
 	double ssim;
 	double msssim;
 	static const int NLEVS = 5;
 	static const double WEIGHT[];
+	Reference levels[NLEVS];	// statistics of each level of the original pyramid
+	// Levels 1 to NLEVS-1 of the pyramids (level 0 is the input image)
+	cv::Mat pyramid1[NLEVS];	// original image, for compute()
+	cv::Mat pyramid2[NLEVS];	// processed image
+	cv::Mat ref_pyramid[NLEVS];	// original image, for setReference()
+	// Compute the next level of a pyramid into dst
+	void downsample(const cv::Mat& src, cv::Mat& dst);
+	// Compute the SSIM index of each level of the pyramids, given by pairs[l].img1 or
+	// pairs[l].ref and pairs[l].img2, and combine them
+	void combine(Pair pairs[NLEVS]);
 };
 
 #endif
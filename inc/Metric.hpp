@@ -26,21 +26,51 @@
 #define Metric_hpp
 
 #include <cmath>
+#include <stdint.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "ThreadPool.hpp"
 
 class Metric {
 public:
 	Metric(int height, int width);
 	virtual ~Metric();
 	virtual float compute(const cv::Mat& original, const cv::Mat& processed) = 0;
+	// Number of buffers allocated by allocate() so far
+	uint64_t getAllocations() const;
+	// Split the following frames into bands of rows computed in parallel on 'pool',
+	// NULL to compute them on the calling thread only
+	// The results do not depend on the number of threads
+	virtual void setPool(ThreadPool *pool);
 protected:
 	int height;
 	int width;
+	// Rows of a band: a multiple of the block sizes of the metrics
+	static const int BAND = 64;
+	// Number of bands of 'rows' rows, a single one without pool
+	int bands(int rows) const;
+	// Rows [first,last) of band i of 'rows' rows
+	void band(int i, int rows, int& first, int& last) const;
+	// Number of runners of parallel(), which can each use their own buffers
+	int runners() const;
+	// Run body(i, runner) for i in [0,n), in parallel if there is a pool
+	// The partial results need to be reduced in the order of i, to stay deterministic
+	void parallel(int n, const ThreadPool::Body& body);
+	// Make m a rows x cols CV_32F matrix, reusing its buffer if it already has this size
+	// Metrics keep their temporaries as members sized by allocate(), so that once every
+	// buffer has been used, the following frames do not allocate any memory
+	void allocate(cv::Mat& m, int rows, int cols);
 	// Smoothing using a Gaussian kernel of size ksize with standard deviation sigma
 	// Returns only those parts of the correlation that are computed without zero-padded edges
 	// (similarly to 'filter2' in Matlab with option 'valid')
 	void applyGaussianBlur(const cv::Mat& src, cv::Mat& dst, int ksize, double sigma);
+	// Sum of the n values of data, accumulated in double precision
+	// The summation order does not depend on the instruction set
+	static double sum(const float *data, int n);
+private:
+	uint64_t allocations;
+	ThreadPool *pool;
+	cv::Mat blurred;	// temporary of applyGaussianBlur()
 };
 
 #endif
@@ -0,0 +1,101 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Local Gaussian moments of two images.
+
+ Computes, one output row at a time, the Gaussian-weighted local means of
+ img1, img2, img1.*img1, img2.*img2 and img1.*img2 over the 'valid' region
+ (similarly to 'filter2' in Matlab with option 'valid'). The separable
+ filter runs on a rolling buffer of ksize horizontally filtered rows, so
+ that no full-frame temporary is needed.
+
+ The moments of img1 alone and the moments that depend on img2 can also be
+ computed separately, so that the former are shared between several
+ processed images.
+
+ The same filter also blurs and decimates an image by two in both
+ directions, as in the construction of a pyramid.
+
+**************************************************************************/
+
+#ifndef MomentFilter_hpp
+#define MomentFilter_hpp
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+enum Moments {
+	// Moments of img1 alone
+	MOMENT_MU1 = 0,	// filter2(win, img1, 'valid')
+	MOMENT_SQ1,	// filter2(win, img1.*img1, 'valid')
+	// Moments that depend on img2
+	MOMENT_MU2,	// filter2(win, img2, 'valid')
+	MOMENT_SQ2,	// filter2(win, img2.*img2, 'valid')
+	MOMENT_12,	// filter2(win, img1.*img2, 'valid')
+	MOMENT_SIZE
+};
+
+class MomentFilter {
+public:
+	MomentFilter(int ksize, double sigma);
+	// Start filtering img1 and img2 (CV_32F) at output row 'row'
+	void begin(const cv::Mat& img1, const cv::Mat& img2, int row = 0);
+	// Same as begin(), but only compute MOMENT_MU1 and MOMENT_SQ1
+	void beginReference(const cv::Mat& img1, int row = 0);
+	// Same as begin(), but only compute MOMENT_MU2, MOMENT_SQ2 and MOMENT_12
+	void beginProcessed(const cv::Mat& img1, const cv::Mat& img2, int row = 0);
+	// Compute the next output row
+	void next();
+	// Width of the output rows
+	int cols() const;
+	// Output row of the given moment computed by the last call to next()
+	// Only valid for the moments selected by begin()
+	const float* row(int moment) const;
+	// Filter src (CV_32F) and keep every other row and column of the 'valid' region,
+	// starting with the first one, into dst, which gives the size of the output
+	// Only the retained samples are computed; cancels the last call to begin()
+	// Only rows [first,last) of dst are written, all of them if last is negative
+	void decimate(const cv::Mat& src, cv::Mat& dst, int first = 0, int last = -1);
+private:
+	int ksize;
+	std::vector<float> kernel;
+	cv::Mat img1;
+	cv::Mat img2;
+	int in_cols;
+	int out_cols;
+	int next_row;			// next output row
+	unsigned int selected;		// bit m is set if moment m is computed
+	std::vector<float> product;	// product of one input row
+	std::vector<float> ring;	// last ksize horizontally filtered rows of each moment
+	std::vector<float> out;		// output rows of each moment
+	std::vector<const float*> window;	// rows of the rolling buffer in the vertical window
+	void start(const cv::Mat& img1, const cv::Mat& img2, int row, unsigned int moments);
+	// Horizontally filter input row y into the rolling buffer
+	void filterRow(int y);
+	float* ringRow(int moment, int y);
+};
+
+#endif
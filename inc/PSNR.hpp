@@ -31,13 +31,30 @@
 #ifndef PSNR_hpp
 #define PSNR_hpp
 
+#include <vector>
 #include "Metric.hpp"
 
 class PSNR : protected Metric {
 public:
-	PSNR(int height, int width);
+	// Integer images have 'bitdepth' bits per sample, floating-point images are in the 8-bit range
+	PSNR(int height, int width, int bitdepth = 8);
 	// Compute the PSNR index of the processed image
+	// Integer images (CV_8U or CV_16U) are compared exactly with integer arithmetic
 	float compute(const cv::Mat& original, const cv::Mat& processed);
+	// Keep the original image for the following calls to compare()
+	// The original image needs to stay unchanged until the last call to compare()
+	void setReference(const cv::Mat& original);
+	// Compute the PSNR index of the processed image against the last reference
+	float compare(const cv::Mat& processed);
+	// Compute the bands of rows of the following integer images in parallel (see Metric::setPool())
+	void setPool(ThreadPool *pool);
+	using Metric::getAllocations;
+	// Largest finite PSNR index, of integer images differing by one in a single sample
+	static float maxIndex(int height, int width, int bitdepth);
+private:
+	int bitdepth;
+	cv::Mat reference;
+	std::vector<uint64_t> band_sse;	// sum of squared errors of each band
 };
 
 #endif
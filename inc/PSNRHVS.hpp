@@ -53,7 +53,9 @@
 #ifndef PSNRHVS_hpp
 #define PSNRHVS_hpp
 
+#include <vector>
 #include "Metric.hpp"
+#include "BlockDCT.hpp"
 
 class PSNRHVS : protected Metric {
 public:
@@ -61,19 +63,61 @@ public:
 	// Compute the PSNR-HVS-M and PSNR-HVS indexes of the processed image
 	// Return the PSNR-HVS-M index
 	float compute(const cv::Mat& original, const cv::Mat& processed);
+	// Compute the DCT coefficients and masking of the original image that are
+	// shared by the following calls to compare()
+	void setReference(const cv::Mat& original);
+	// Compute the PSNR-HVS-M and PSNR-HVS indexes of the processed image against the last reference
+	// Return the PSNR-HVS-M index
+	float compare(const cv::Mat& processed);
 	// Return the PSNR-HVS index only
 	// compute() needs to be called before getPSNRHVS()
 	float getPSNRHVS();
 	// Return the PSNR-HVS-M index only
 	// compute() needs to be called before getPSNRHVSM()
 	float getPSNRHVSM();
+	// Write the PSNR-HVS-M error of each 8x8 block of the following frames to 'map'
+	// ((height/8) x (width/8) values), NULL to skip it
+	// The error is the mean squared masked difference of the block, from which the
+	// PSNR-HVS-M index of the block is 10*log10(255*255/error)
+	void setMap(float *map);
+	// Index of a processed image without error
+	static const float MAX_INDEX;
+	// Compute the bands of strips of the following frames in parallel (see Metric::setPool())
+	void setPool(ThreadPool *pool);
+	using Metric::getAllocations;
 private:
 	float psnrhvs;
 	float psnrhvsm;
+	float *map;	// errors of the blocks, NULL if not needed
 	static const float CSF[8][8];
 	static const float MASK[8][8];
-	float maskeff(const cv::Mat &z, const cv::Mat &zdct);
-	float vari(const cv::Mat &z);
+	// Tables indexed as [l][k], matching the layout of BlockDCT::row()
+	float csf_t[8][8];
+	float mask_t[8][8];
+	float ac_t[8][8];	// 0 for the DC coefficient, 1 otherwise
+	// Buffers of one runner of Metric::parallel()
+	struct Runner {
+		BlockDCT dct_a;
+		BlockDCT dct_b;
+		std::vector<float> mask_a;
+		std::vector<float> mask_b;
+		std::vector<float> lanes1;
+		std::vector<float> lanes2;
+		explicit Runner(int w);
+	};
+	std::vector<Runner> runner_buffers;
+	cv::Mat ref_dct;	// DCT coefficients of the original image, with the layout of BlockDCT::row()
+	cv::Mat ref_mask;	// masking of each block of the original image
+	// Errors of each block for PSNR-HVS-M and PSNR-HVS, reduced in order
+	std::vector<float> errors1;
+	std::vector<float> errors2;
+	// Compute the masking of each block of a strip, using 'lanes' as temporary
+	void maskeff(const BlockDCT& dct, float *mask, float *lanes) const;
+	// Compute the errors of the blocks of the strip of the processed image starting at row y,
+	// given the DCT coefficients and masking of the original strip
+	void compareStrip(const cv::Mat& processed, int y, const float *const dct_rows[8], const float *mask_ref, Runner& runner);
+	// Compute the indexes from the errors of the blocks
+	void finish();
 };
 
 #endif
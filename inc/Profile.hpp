@@ -0,0 +1,125 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Timing of the processing stages.
+
+ Each stage keeps a histogram of the time taken by its individual calls
+ (one sample per frame, or per component and frame for the metrics), with
+ a relative resolution of 1/8, from which percentiles are estimated.
+ Recording a sample only costs a few arithmetic operations, so timing is
+ always enabled. The buffers allocated by the metrics in the steady state
+ are counted as well, and so are the components whose computation was
+ skipped or shortened.
+
+ A Profile is not thread-safe: each thread records into its own instance,
+ and the instances are merged at the end.
+
+**************************************************************************/
+
+#ifndef Profile_hpp
+#define Profile_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum Stages {
+	STAGE_READ = 0,		// reading one frame of both videos
+	STAGE_COPY,		// copy of the components of the videos into a frame slot, unless mapped
+	STAGE_CONVERT,		// conversion of one component to floating-point
+	STAGE_HASH,		// fingerprint of one component of the original and processed frames
+	STAGE_PSNR,
+	STAGE_SSIM,
+	STAGE_MSSSIM,
+	STAGE_VIFP,
+	STAGE_PSNRHVS,
+	STAGE_WAIT,		// waiting for a free frame slot (computation-bound)
+	STAGE_FRAME,		// latency of one frame, from submission to the last metric
+	STAGE_WRITE,		// serialization of the results of one frame, in the writer thread
+	STAGE_SIZE
+};
+
+enum Counters {
+	COUNTER_CACHE_HIT = 0,	// components whose quality indexes were found in the frame cache
+	COUNTER_CACHE_MISS,	// components computed while the frame cache is enabled
+	COUNTER_IDENTICAL,	// components whose processed frame is identical to the original
+	COUNTER_SIZE
+};
+
+class Histogram {
+public:
+	Histogram();
+	void record(double seconds);
+	void merge(const Histogram& other);
+	uint64_t count() const;
+	double total() const;
+	double max() const;
+	// Estimate of the p-th percentile (0 < p <= 100), 0 if empty
+	double percentile(double p) const;
+private:
+	static const int SUB_BUCKETS = 8;	// buckets per power of two
+	static const int BUCKETS = 64*SUB_BUCKETS;
+	uint64_t counts[BUCKETS];	// samples counted per bucket of nanoseconds
+	uint64_t nb;
+	double sum;
+	double maximum;
+	static int bucket(double ns);
+	static double bucketValue(int b);
+};
+
+class Profile {
+public:
+	Profile();
+	void record(int stage, double seconds);
+	// Count buffers allocated by the metrics after the first frame
+	void recordAllocations(uint64_t n);
+	uint64_t getAllocations() const;
+	void count(int counter);
+	uint64_t getCount(int counter) const;
+	void merge(const Profile& other);
+	// Write the statistics of the stages that have samples as a JSON object
+	void write(FILE *file) const;
+	// Monotonic time in seconds
+	static double now();
+private:
+	Histogram stages[STAGE_SIZE];
+	uint64_t allocations;
+	uint64_t counters[COUNTER_SIZE];
+};
+
+// Times consecutive stages: each lap records the time elapsed since the
+// previous lap (or since construction)
+class StageTimer {
+public:
+	explicit StageTimer(Profile& profile);
+	void lap(int stage);
+private:
+	Profile& profile;
+	double start;
+	StageTimer(const StageTimer&);
+	StageTimer& operator=(const StageTimer&);
+};
+
+#endif
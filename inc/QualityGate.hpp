@@ -0,0 +1,116 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Quality thresholds of a QC gate.
+
+ The quality indexes of each processed video are checked as they are
+ written out, in frame order, against:
+ - per-frame floors: a frame is bad when one of its quality indexes is
+   below the floor of its metric, or not a number
+ - rolling-window floors: the video is rejected when the mean of a metric
+   over the last frames is below the floor of the window
+ - a maximum number of bad frames, above which the video is rejected
+ The value checked is the one written to the output: the luma quality
+ index, or the weighted combination of the components with -chroma.
+
+**************************************************************************/
+
+#ifndef QualityGate_hpp
+#define QualityGate_hpp
+
+#include <stdio.h>
+#include <atomic>
+#include <vector>
+#include "Evaluator.hpp"
+#include "VideoYUV.hpp"
+
+class QualityGate {
+public:
+	QualityGate();
+	// A frame is bad when the quality index of 'metric' is below 'floor'
+	void setFloor(int metric, float floor);
+	// A video is rejected when the mean quality index of 'metric' over 'length' frames is below 'floor'
+	void setWindow(int metric, int length, float floor);
+	// A video is rejected when more than 'count' frames are bad (default: 0)
+	void setMaxBad(int count);
+	// Quality indexes of 'metric' above 'value' are checked as 'value', so that an infinite index
+	// (e.g. the PSNR of identical frames) does not hide the bad frames of its windows
+	void setMaxIndex(int metric, float value);
+	// Whether a threshold has been set on 'metric'
+	bool hasThreshold(int metric) const;
+	// Whether any threshold has been set
+	bool isEnabled() const;
+	// Whether a per-frame floor has been set on any metric, without which no frame is bad
+	bool hasFloor() const;
+	// Start checking 'nbvideos' processed videos, on their first 'nbplanes' components
+	// Needs to be called after the thresholds have been set, before the first call to check()
+	void start(int nbvideos, int nbplanes);
+	// Check the quality indexes of one frame of a processed video
+	// The frames of each processed video have to be checked in order, one call at a time
+	void check(int frame, int video, const float result[PLANE_SIZE][METRIC_SIZE]);
+	// Whether a processed video has been rejected, can be called from any thread
+	bool isRejected() const;
+	// Whether the given processed video has been rejected, can be called from any thread
+	bool isRejected(int video) const;
+	// Whether all processed videos have been rejected, can be called from any thread
+	bool allRejected() const;
+	// Print the verdict and the offending frames of each rejected video
+	void writeSummary(FILE *file, const char *const metric_names[METRIC_SIZE], const std::vector<const char*>& video_names) const;
+	// Print the verdict as JSON fields (without the enclosing braces)
+	void writeReport(FILE *file) const;
+private:
+	// Frame, or run of frames for a window, below a floor
+	struct Violation {
+		int first;	// first frame
+		int last;	// last frame
+		int metric;
+		float value;	// quality index, or its mean over the window
+		float floor;
+	};
+	struct Window {
+		std::vector<float> values;	// ring of the last quality indexes
+		std::vector<int> frames;	// their frame numbers
+		int count;			// number of values in the ring
+		int next;			// next position in the ring
+	};
+	struct Video {
+		std::vector<Violation> violations;
+		Window window[METRIC_SIZE];
+		int bad;			// number of bad frames
+		std::atomic<bool> rejected;
+	};
+	float floor[METRIC_SIZE];		// per-frame floors
+	bool has_floor[METRIC_SIZE];
+	int window_length[METRIC_SIZE];		// 0 without a window
+	float window_floor[METRIC_SIZE];
+	float max_index[METRIC_SIZE];		// infinity without a maximum
+	int max_bad;
+	int nbplanes;
+	std::vector<Video> videos;
+	std::atomic<bool> rejected;
+};
+
+#endif
@@ -0,0 +1,138 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Output of the quality indexes, serialized in a background thread.
+
+ The results of each processed video are written either to one CSV file
+ per metric, to a single CSV file with one column per metric, or to a
+ single binary file. In the combined outputs, the columns are named after
+ the metric ("psnr"), or after the metric and the component with -chroma
+ ("psnr_y", "psnr_u", "psnr_v", "psnr_yuv").
+
+ The binary file is made of little-endian fields:
+ - the magic number "VQMT", and the version of the format (uint32, 1)
+ - the number of columns C (uint32) and their names (16 bytes each,
+   padded with zeros)
+ - one row per frame: the frame number (int32) and the C values (float32)
+ - a last row with the averages, with frame number -1
+
+ The per-block maps of the luma component are written to <output>_maps.bin,
+ made of little-endian fields:
+ - the magic number "VQMM", and the version of the format (uint32, 1)
+ - the number of maps M (uint32), and for each map its name (16 bytes,
+   padded with zeros), block size, number of rows and of columns (uint32)
+ - one record per frame: the frame number (int32) and the values of the
+   M maps one after the other (float32, row-major)
+ All records have the same size, so that the file can be memory-mapped
+ as an array of records following the header.
+
+**************************************************************************/
+
+#ifndef ResultWriter_hpp
+#define ResultWriter_hpp
+
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Evaluator.hpp"
+#include "Profile.hpp"
+#include "VideoYUV.hpp"
+
+enum OutputFormats {
+	FORMAT_SPLIT = 0,	// Output_<metric>.csv for each metric
+	FORMAT_CSV,		// Output.csv
+	FORMAT_BINARY,		// Output.bin
+	FORMAT_SIZE
+};
+
+class ResultWriter {
+public:
+	// The results of processed video v are written to files named after outputs[v]
+	// The first 'nbplanes' components are written, with their weighted combination if there are several
+	// Written rows are flushed to the files when 'flush' is set
+	ResultWriter(int format, const std::vector<const char*>& outputs, const bool metrics[METRIC_SIZE],
+		int nbplanes, bool flush);
+	~ResultWriter();
+	// Write the maps of the given layout (see FrameEngine::setMaps()) to <output>_maps.bin
+	// Needs to be called before the first call to write()
+	void setMaps(const MapLayout layout[MAP_SIZE]);
+	// Queue the quality indexes of one frame of a processed video
+	// The frames of each processed video have to be queued in order
+	// along with its maps if they have been requested with setMaps()
+	void write(int frame, int video, const float result[PLANE_SIZE][METRIC_SIZE], const float *maps = NULL);
+	// Write out the queued frames and the averages, and close the files
+	void close();
+	// Add the time taken by the serialization to 'total'
+	// close() needs to be called before getProfile()
+	void getProfile(Profile& total) const;
+	// Weighted combination of the quality indexes of the three components, written with -chroma
+	static float combine(const float result[PLANE_SIZE][METRIC_SIZE], int m);
+private:
+	struct Record {
+		int frame;
+		int video;
+		float result[PLANE_SIZE][METRIC_SIZE];
+		std::vector<float> maps;
+	};
+	struct Output {
+		FILE *file[METRIC_SIZE];		// one per metric (FORMAT_SPLIT), otherwise only the first one
+		float avg[PLANE_SIZE][METRIC_SIZE];	// sum, then average, of the quality indexes
+		int nbframes;				// number of frames written
+		FILE *maps;				// NULL if the maps are not requested
+	};
+	int format;
+	bool enabled[METRIC_SIZE];
+	int nbplanes;
+	bool flush;
+	std::vector<Output> outputs;
+	std::vector<const char*> names;
+	size_t map_size;		// number of values in the maps of a frame
+	std::vector<unsigned char> row;	// binary row being serialized
+	Profile profile;		// written by the writer thread
+	// Queue of the records, shared with the writer thread
+	std::deque<Record> queue;
+	std::deque<Record> batch;	// records being written, owned by the writer thread
+	std::vector<std::vector<float> > spare;	// buffers of the written maps, reused by write()
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool closing;
+	std::thread thread;
+	// Writer thread loop
+	void loop();
+	// Write one row of quality indexes, or the averages if 'frame' is negative
+	void writeRow(Output& output, int frame, const float result[PLANE_SIZE][METRIC_SIZE]);
+	// Write the header of the files
+	void writeHeader(Output& output);
+	// Write the maps of one frame
+	void writeMaps(Output& output, int frame, const std::vector<float>& maps);
+	ResultWriter(const ResultWriter&);
+	ResultWriter& operator=(const ResultWriter&);
+};
+
+#endif
@@ -42,19 +42,84 @@
 #ifndef SSIM_hpp
 #define SSIM_hpp
 
+#include <vector>
 #include "Metric.hpp"
+#include "MomentFilter.hpp"
 
 class SSIM : protected Metric {
 public:
 	SSIM(int height, int width);
 	// Compute the SSIM index of the processed image
 	float compute(const cv::Mat& original, const cv::Mat& processed);
+	// Compute the statistics of the original image that are shared by the
+	// following calls to compare()
+	// The original image needs to stay unchanged until the last call to compare()
+	void setReference(const cv::Mat& original);
+	// Compute the SSIM index of the processed image against the last reference
+	// Gives the same result as compute()
+	float compare(const cv::Mat& processed);
+	// Pool the SSIM map of the following frames into the means of blocks of
+	// MAP_BLOCK x MAP_BLOCK windows, written to 'map' (mapRows() x mapCols() values)
+	// Block (i,j) pools the windows whose top-left sample is in block (i,j) of the image
+	// The pooling is skipped when 'map' is NULL
+	void setMap(float *map);
+	int mapRows() const;
+	int mapCols() const;
+	static const int MAP_BLOCK = 16;
+	// Compute the bands of rows of the following frames in parallel (see Metric::setPool())
+	void setPool(ThreadPool *pool);
+	using Metric::getAllocations;
 protected:
+	// Local moments of an original image, independent of the processed image
+	struct Reference {
+		cv::Mat img;	// original image
+		cv::Mat mu;	// filter2(window, img1, 'valid')
+		cv::Mat sq;	// filter2(window, img1.*img1, 'valid')
+	};
+	// One image pair of computeSSIM()
+	struct Pair {
+		const cv::Mat *img1;	// original image, NULL if ref is given instead
+		const Reference *ref;	// local moments of the original image, computed by prepareSSIM()
+		const cv::Mat *img2;	// processed image
+		float *pooled;		// pooled SSIM map, NULL if not needed
+		cv::Scalar res;		// SSIM index and mean of the contrast comparison function
+		// Set by computeSSIM()
+		int rows;
+		int first_band;
+		size_t offset;		// offset of the first row in row_sums
+	};
+	float *map;	// pooled SSIM map, NULL if not needed
 	// Compute the SSIM index and mean of the contrast comparison function
-	cv::Scalar computeSSIM(const cv::Mat& img1, const cv::Mat& img2);
+	// The SSIM map is pooled into 'pooled' unless it is NULL
+	cv::Scalar computeSSIM(const cv::Mat& img1, const cv::Mat& img2, float *pooled);
+	// Compute the local moments of img1 into the buffers of ref
+	void prepareSSIM(const cv::Mat& img1, Reference& ref);
+	// Same as computeSSIM(), with the local moments of img1 computed by prepareSSIM()
+	cv::Scalar computeSSIM(const Reference& ref, const cv::Mat& img2, float *pooled);
+	// Compute the n pairs at once, so that the bands of all of them run in parallel
+	void computeSSIM(Pair pairs[], int n);
 private:
 	static const float C1;
 	static const float C2;
+	// Buffers of one runner of Metric::parallel()
+	struct Runner {
+		MomentFilter filter;
+		std::vector<float> ssim_row;
+		std::vector<float> cs_row;
+		std::vector<double> block_sums;	// sums of the SSIM map over the blocks of the current block row
+		Runner(int w, int map_cols);
+	};
+	Reference reference;
+	std::vector<Runner> runner_buffers;
+	std::vector<double> row_sums;	// sums of the SSIM index and contrast comparison function of each row
+	// Compute rows [first,last) of a pair into row_sums
+	void computeRows(const Pair& pair, int first, int last, Runner& runner);
+	// Sum the SSIM index and contrast comparison function over one row of local moments
+	static void sumRow(const float *mu1, const float *img1_sq, const float *mu2, const float *img2_sq,
+		const float *img1_img2, int w, Runner& runner, double& ssim_sum, double& cs_sum);
+	// Pool row y of the h x w SSIM map, written to 'pooled' at the last row of each block
+	// The bands start at the first row of a block
+	static void poolRow(int y, int h, int w, Runner& runner, float *pooled);
 };
 
 #endif
@@ -0,0 +1,101 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Hot kernels vectorized for several instruction sets, with the best one
+ supported by the processor selected at run time.
+
+ The kernels of each instruction set are built in their own translation
+ unit (Simd<ISA>.cpp), with the matching compiler flags. They all perform
+ the same floating-point operations in the same order on each sample (no
+ fused multiply-add, no reassociation), so that the results do not depend
+ on the selected instruction set.
+
+**************************************************************************/
+
+#ifndef Simd_hpp
+#define Simd_hpp
+
+#include <stdint.h>
+
+enum Isas {
+	ISA_GENERIC = 0,	// plain C++, vectorized by the compiler for the baseline
+	ISA_SSE2,
+	ISA_AVX2,
+	ISA_AVX512,		// AVX-512 F and BW
+	ISA_SIZE
+};
+
+// Hash of hashBlocks(): HASH_LANES 64-bit lanes, each one hashing one word of each block
+static const int HASH_LANES = 8;
+static const uint64_t HASH_PRIME1 = 0x9E3779B185EBCA87ull;
+static const uint64_t HASH_PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+struct SimdKernels {
+	// dst[x] = sum_t kernel[t]*src[x+t], for x in [0,n)
+	void (*convolveRow)(const float *src, float *dst, const float *kernel, int ksize, int n);
+	// dst[x] = sum_t kernel[t]*rows[t][x], for x in [0,n)
+	void (*convolveColumn)(const float *const *rows, float *dst, const float *kernel, int ksize, int n);
+	// dst[x] = src[x]*scale
+	void (*convert8)(const uint8_t *src, float *dst, float scale, int n);
+	void (*convert16)(const uint16_t *src, float *dst, float scale, int n);
+	// Sum of the squared differences, exact for any samples: 'bitdepth' is the expected number of bits
+	// of the 16-bit samples, samples above it only take a slower path
+	uint64_t (*squaredError8)(const uint8_t *a, const uint8_t *b, int n);
+	uint64_t (*squaredError16)(const uint16_t *a, const uint16_t *b, int n, int bitdepth);
+	// dst[k*stride+x] = sum_i basis[k][i]*src[i][x], for k in [0,8) and x in [0,n)
+	void (*dctColumns)(const float *const src[8], float *dst, int stride, const float basis[8][8], int n);
+	// Hash n blocks of 8*HASH_LANES bytes: for each block, lane l takes the little-endian
+	// word w at bytes [8*l,8*l+8), state[l] = rotl(state[l] + w*HASH_PRIME2, 31)*HASH_PRIME1
+	void (*hashBlocks)(const uint8_t *data, int n, uint64_t state[HASH_LANES]);
+};
+
+class Simd {
+public:
+	// Kernels of the selected instruction set
+	static const SimdKernels& kernels();
+	// Select the kernels of the given instruction set, instead of the best one
+	// Returns false if the instruction set is not supported by the processor or the build
+	// Needs to be called before any computation
+	static bool select(int isa);
+	// Selected instruction set
+	static int selected();
+	// Best instruction set supported by the processor and the build
+	static int best();
+	static bool isSupported(int isa);
+	// Name of the selected instruction set
+	static const char* name();
+	// Instruction set of the given name, -1 if unknown
+	static int find(const char *name);
+private:
+	static bool isSupportedByProcessor(int isa);
+};
+
+// Fill 'table' with the kernels of each instruction set, false if they are not built
+bool initSSE2(SimdKernels& table);
+bool initAVX2(SimdKernels& table);
+bool initAVX512(SimdKernels& table);
+
+#endif
@@ -0,0 +1,77 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Fixed-size pool of worker threads.
+
+ Tasks are executed in submission order by the first idle worker and
+ receive the index of that worker, so that callers can keep per-worker
+ state (e.g. one set of metric instances per thread).
+
+ A task can also split its work into a parallel loop: the iterations are
+ run by the task itself, and taken over by the workers that become idle
+ meanwhile.
+
+**************************************************************************/
+
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+	typedef std::function<void(int)> Task;
+	// Iteration of a parallel loop, given its index and the runner executing it
+	typedef std::function<void(int index, int runner)> Body;
+	explicit ThreadPool(int nbthreads);
+	~ThreadPool();
+	// Number of worker threads
+	int size() const;
+	// Queue a task, the argument passed to the task is the worker index
+	void run(const Task& task);
+	// Run body(i, runner) for i in [0,n) on the calling thread and on idle workers, and return
+	// once all the iterations are done
+	// Concurrent iterations have distinct runners, in [0,size()]: callers can keep per-runner
+	// buffers. The calling thread only waits for the iterations being run by other workers,
+	// so that the tasks of the pool can run parallel loops
+	void parallelFor(int n, const Body& body);
+	// Return the number of hardware threads (at least 1)
+	static int hardwareThreads();
+private:
+	std::vector<std::thread> threads;
+	std::deque<Task> tasks;
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool stop;
+	void loop(int id);
+};
+
+#endif
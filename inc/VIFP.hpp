@@ -55,18 +55,71 @@
 #ifndef VIFP_hpp
 #define VIFP_hpp
 
+#include <functional>
+#include <vector>
 #include "Metric.hpp"
+#include "MomentFilter.hpp"
 
 class VIFP : protected Metric {
 public:
 	VIFP(int height, int width);
 	// Compute the VIFp index of the processed image
 	float compute(const cv::Mat& original, const cv::Mat& processed);
+	// Compute the pyramid and statistics of the original image that are shared
+	// by the following calls to compare()
+	// The original image needs to stay unchanged until the last call to compare()
+	void setReference(const cv::Mat& original);
+	// Compute the VIFp index of the processed image against the last reference
+	// Gives the same result as compute()
+	float compare(const cv::Mat& processed);
+	// Compute the bands of rows of all the subbands in parallel (see Metric::setPool())
+	void setPool(ThreadPool *pool);
+	using Metric::getAllocations;
 private:
 	static const int NLEVS = 4;
 	static const float SIGMA_NSQ;
-	// Compute the coefficients of the VIFp index at a particular subband
-	void computeVIFP(const cv::Mat& ref, const cv::Mat& dist, int N, double& num, double& den);
+	// Statistics of the original image at a particular subband
+	struct Scale {
+		cv::Mat ref;		// original image
+		cv::Mat mu1;		// filter2(win, ref, 'valid')
+		cv::Mat sigma1_sq;	// local variance, clipped at 0
+	};
+	// Buffers of one runner of Metric::parallel()
+	struct Runner {
+		std::vector<MomentFilter> filters;	// Gaussian window of each scale
+		std::vector<float> sigma1_sq_row;	// local variance of one row of the original image
+		std::vector<float> log_row;		// arguments of the logarithms of one row
+		explicit Runner(int w);
+	};
+	// Computation of rows [first,last) of the local moments of a subband
+	typedef std::function<void(int scale, int first, int last, Runner& runner)> ScaleBody;
+	Scale scales[NLEVS];
+	double den;	// denominator of the VIFp index, only depends on the original image
+	std::vector<Runner> runner_buffers;
+	int rows[NLEVS];		// rows of the local moments of each subband
+	size_t offsets[NLEVS];		// offset of the first row of each subband in num_rows and den_rows
+	// Terms of each row of the numerator and denominator, reduced in order
+	std::vector<double> num_rows;
+	std::vector<double> den_rows;
+	// Subbands 1 to NLEVS-1 (subband 0 is the input image)
+	cv::Mat ref_levels[NLEVS];	// original image, for compute()
+	cv::Mat dist_levels[NLEVS];	// processed image
+	// Filter src with the window of the given scale, of size N, and keep every other
+	// row and column
+	void downsample(int scale, int N, const cv::Mat& src, cv::Mat& dst);
+	// Run body over the bands of rows of all the subbands, in parallel
+	void parallelScales(const ScaleBody& body);
+	// Compute one row of the local variance of the original image from its first two
+	// moments, and return its term of the denominator
+	static double prepareRow(const float *mu1, const float *ref_sq, float *sigma1_sq, float *arg, int w);
+	// Return the term of one row of local moments of the numerator of the VIFp index
+	static double compareRow(const float *mu1, const float *sigma1_sq, const float *mu2, const float *dist_sq,
+		const float *ref_dist, float *arg, int w);
+	// Sum of the terms of the rows, in the order of the rows
+	static double sumRows(const std::vector<double>& terms);
+	// Replace the n values of data by their natural logarithm and return their sum
+	// (the log10 factors of the numerator and denominator cancel out)
+	static double sumLog(float *data, int n);
 };
 
 #endif
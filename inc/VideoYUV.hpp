@@ -28,6 +28,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <opencv2/core/core.hpp>
 
 // _WIN32 is also defined in WIN64 environment (why on earth? => backward
@@ -37,6 +40,8 @@
 #include <io.h>
 #else /* Linux, *BSD, ... */
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif /* _WIN32 */
 
 #ifdef __linux__
@@ -59,15 +64,59 @@ enum ChromaSubsampling {
 	CHROMA_SUBSAMP_444 = 3
 };
 
+// Component definitions
+enum Planes {
+	PLANE_Y = 0,
+	PLANE_U = 1,
+	PLANE_V = 2,
+	PLANE_SIZE
+};
+
 class VideoYUV {
 public:
-	VideoYUV(const char *file, int height, int width, int nbframes, int chroma_format);
+	VideoYUV(const char *file, int height, int width, int nbframes, int chroma_format, int bitdepth = 8);
 	~VideoYUV();
 	// Read one frame
+	// Regular files are memory-mapped and the frame planes point directly into
+	// the mapping, other inputs (e.g. stdin) are read into an internal buffer
 	bool readOneFrame();
+	// Only return frames start, start+stride, ... before 'end' (excluded), or until the
+	// end of the input if 'end' is negative
+	// Skipped frames are seeked over, except on streams that cannot seek (e.g. pipes)
+	// Needs to be called before the first call to readOneFrame()
+	void setRange(long start, long end, int stride);
+	// Only read the luma samples, the chroma planes are skipped on disk
+	// Needs to be called before the first call to readOneFrame()
+	void setLumaOnly(bool enable);
+	// Read up to 'depth' frames ahead of readOneFrame() in a background thread
+	// Needs to be called before the first call to readOneFrame()
+	void prefetch(int depth);
+	// Keep the last 'frames' frames returned by readOneFrame() resident in memory, when they
+	// are still used after the next call (e.g. through referPlane()) (default: 0)
+	// Needs to be called before the first call to readOneFrame()
+	void setRetained(int frames);
 	// Get the luma component
 	// readOneFrame() needs to be called before getLuma()
-	void getLuma(cv::Mat& luma, int type = CV_8UC1);
+	void getLuma(cv::Mat& luma, int type = -1);
+	// Get one component (PLANE_Y, PLANE_U or PLANE_V)
+	// Components are returned as CV_8UC1, or CV_16UC1 above 8 bits, unless another type is given
+	// readOneFrame() needs to be called before getPlane()
+	void getPlane(int plane, cv::Mat& component, int type = -1);
+	// Point 'component' to one component of the last frame read, without copying it, when the
+	// file is memory-mapped: the samples stay valid until the VideoYUV is destroyed
+	// Returns false when the samples have to be copied with getPlane() (e.g. from a stream)
+	bool referPlane(int plane, cv::Mat& component);
+	// Dimensions of one component (0 for the chroma components of YUV400)
+	int getHeight(int plane) const;
+	int getWidth(int plane) const;
+	// Number of bits per sample
+	int getBitDepth() const;
+	// Whether the last call to readOneFrame() failed because the input ended
+	// between two frames, rather than on a read error or inside a frame
+	bool hasEnded() const;
+	// Whether the last call to readOneFrame() failed because the input ended inside a frame
+	// The caller reports it, e.g. as the partial last frame of an interrupted stream
+	bool isTruncated() const;
 private:
 	FILE* file;		// file stream
 	int nbframes;		// number of frames
@@ -76,12 +125,60 @@ private:
 	int comp_height[3];	// height in specific component
 	int comp_width[3];	// width in specific component
 
-	int size;		// number of samples
-	int comp_size[3];	// number of samples in specific component
+	int bitdepth;		// number of bits per sample
+	int sample_bytes;	// number of bytes per sample
 
-	imgpel *data;		// data array
+	int size;		// number of bytes per frame
+	int comp_size[3];	// number of bytes in specific component
+
+	imgpel *data;		// ring of frame buffers (NULL when the file is memory-mapped)
+	int ring_frames;	// number of frames in the ring
 	imgpel *luma;		// pointer to luma
-	imgpel *chroma[2];	// pointers to chroma
+	imgpel *chroma[2];	// pointers to chroma (NULL when reading luma only)
+	bool luma_only;		// chroma samples are skipped
+	bool seekable;		// the stream supports seeking
+	int retained;		// returned frames kept resident after the next call to readOneFrame()
+
+	imgpel *map;		// read-only mapping of the file (NULL when reading from the stream)
+	size_t map_size;	// size of the mapping in bytes
+
+	long first_frame;	// first frame returned by readOneFrame()
+	int stride;		// distance between two frames returned by readOneFrame()
+	long nbreads;		// number of frames returned by readOneFrame()
+	long next_frame;	// index of the next frame returned by readOneFrame(), from 0 to nbreads-1
+	long stream_frame;	// frame at the current position of the stream
+
+	// Background reader
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable cond;
+	long fetched;		// number of frames available
+	long released;		// frames before this one are not used anymore
+	bool failed;		// the reader stopped on an error or at the end of the input
+	bool ended;		// the input ended between two frames
+	bool truncated;		// the input ended inside a frame
+	bool stop;		// the reader has to stop
+	unsigned int touched;	// keeps page faulting from being optimized out
+
+	// Memory-map the file if it is a regular file, return false otherwise
+	bool mapFile();
+	// Whether the stream has no more data, without consuming any
+	bool streamEnded();
+	// Handle a short read of 'bytes' bytes: report a read error, or mark the input as truncated
+	void readFailed(int bytes);
+	// Background reader loop
+	void readFrames();
+	// In the following, k is the index of a returned frame, from 0 to nbreads-1
+	// Position of frame k in the file
+	long long framePosition(long k) const;
+	// Read frame k into its buffer, frames have to be fetched in order
+	bool fetchFrame(long k);
+	// Data of frame k
+	imgpel* frameData(long k);
+	// Point the planes to frame k
+	void setPlanes(long k);
+	// Tell the kernel whether the used planes of mapped frame k will be needed
+	void adviseFrame(long k, bool needed);
 };
 
 #endif
@@ -0,0 +1,124 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ libvqmt: in-process computation of the quality metrics.
+
+ A session is created for given frame dimensions, chroma format and set of
+ metrics. Each original frame is pushed together with one or several
+ processed frames (e.g. the renditions of an encoding ladder), as pointers
+ to their planes: the samples are not copied. Frames are computed in the
+ background by a pool of workers, and their results are pulled in push
+ order, followed by the average of each metric over all the frames.
+
+ The functions of a session need to be called from a single thread.
+
+**************************************************************************/
+
+#ifndef vqmt_h
+#define vqmt_h
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Incremented when the structures or functions below change incompatibly
+#define VQMT_API_VERSION 1
+
+// Metrics, selected in the configuration by the mask (1 << VQMT_METRIC_xxx)
+enum vqmt_metric {
+	VQMT_METRIC_PSNR = 0,
+	VQMT_METRIC_SSIM,
+	VQMT_METRIC_MSSSIM,
+	VQMT_METRIC_VIFP,
+	VQMT_METRIC_PSNRHVS,
+	VQMT_METRIC_PSNRHVSM,
+	VQMT_METRIC_SIZE
+};
+
+// Components of a frame
+enum vqmt_plane {
+	VQMT_PLANE_Y = 0,
+	VQMT_PLANE_U,
+	VQMT_PLANE_V,
+	VQMT_PLANE_SIZE
+};
+
+typedef struct vqmt_config {
+	int height;		// luma dimensions
+	int width;
+	int chroma_format;	// 0 (YUV400), 1 (YUV420), 2 (YUV422) or 3 (YUV444)
+	int bitdepth;		// 8 to 16 bits per sample, samples above 8 bits are uint16_t
+	unsigned int metrics;	// mask of the metrics to compute
+	int chroma;		// non-zero to also compute the metrics on the chroma components
+	int videos;		// number of processed frames pushed with each original frame
+	int threads;		// number of workers, 0 for one per hardware thread
+} vqmt_config;
+
+// Frame in the memory of the caller
+typedef struct vqmt_frame {
+	const void *plane[VQMT_PLANE_SIZE];	// first sample of each component (Y only when luma only)
+	int stride[VQMT_PLANE_SIZE];		// distance between two rows, in bytes
+} vqmt_frame;
+
+typedef struct vqmt_result {
+	int frame;	// frame number, in push order from 0 (number of frames for an average)
+	int video;	// processed frame, from 0 to videos-1
+	// Quality indexes, only set for the requested metrics and computed components
+	float value[VQMT_PLANE_SIZE][VQMT_METRIC_SIZE];
+} vqmt_result;
+
+typedef struct vqmt_session vqmt_session;
+
+// Default configuration: 8-bit YUV420 luma, all the metrics, one processed frame, all threads
+// The dimensions need to be set
+void vqmt_config_default(vqmt_config *config);
+// Check a configuration
+// Returns NULL if it is valid, or an error message otherwise
+const char* vqmt_config_check(const vqmt_config *config);
+// Create a session, NULL if the configuration is not valid
+vqmt_session* vqmt_create(const vqmt_config *config);
+// Wait for the pending frames and release the session
+void vqmt_destroy(vqmt_session *session);
+// Push an original frame and the 'videos' processed frames it is compared to
+// The planes are not copied: they need to stay unchanged until the results of the
+// frame have been pulled, or until vqmt_flush() returns
+// Blocks while all the workers are busy; returns 0, or -1 if a plane is missing
+int vqmt_push(vqmt_session *session, const vqmt_frame *original, const vqmt_frame *processed);
+// Get the results of the next processed frame, in push order
+// Returns 1 if a result was available, 0 otherwise (without waiting)
+int vqmt_pull(vqmt_session *session, vqmt_result *result);
+// Wait until the results of all the pushed frames can be pulled
+void vqmt_flush(vqmt_session *session);
+// Average of the quality indexes of a processed video over the frames computed so far,
+// i.e. over all the pushed frames after vqmt_flush()
+// Returns 0, or -1 if 'video' is out of range
+int vqmt_average(const vqmt_session *session, int video, vqmt_result *average);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,137 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <cmath>
+#include "BlockDCT.hpp"
+#include "Simd.hpp"
+
+// vari() of a set of N samples given their sum and sum of squares
+static inline float vari(float sum, float sumsq, float N)
+{
+	float d = sumsq / N;
+	float mean = sum / N;
+	d -= mean*mean;
+	d *= N*N/(N-1);
+	return d;
+}
+
+BlockDCT::BlockDCT(int w) : width(w), nblocks(w/8)
+{
+	const double PI = 3.14159265358979323846;
+	for (int k=0; k<8; k++) {
+		double c = k == 0 ? sqrt(1.0/8) : sqrt(2.0/8);
+		for (int i=0; i<8; i++) {
+			basis[k][i] = static_cast<float>(c*cos((2*i+1)*k*PI/16));
+		}
+	}
+
+	coefs.resize(static_cast<size_t>(8*width));
+	tmp.resize(static_cast<size_t>(8*width));
+	sums.resize(static_cast<size_t>(8*nblocks));
+	var.resize(static_cast<size_t>(nblocks));
+	qvar.resize(static_cast<size_t>(nblocks));
+}
+
+void BlockDCT::transform(const cv::Mat& img, int y)
+{
+	const float *src[8];
+	float *rows[8];
+	for (int i=0; i<8; i++) {
+		src[i] = img.ptr<float>(y+i);
+		rows[i] = &tmp[static_cast<size_t>(i*width)];
+	}
+
+	const SimdKernels& conv = Simd::kernels();
+
+	// Z = C*X
+	conv.dctColumns(src, &tmp[0], width, basis, 8*nblocks);
+
+	// Transpose each block of Z, so that the second pass also runs down the columns
+	for (int b=0; b<nblocks; b++) {
+		for (int k=0; k<8; k++) {
+			for (int l=0; l<8; l++) {
+				coefs[static_cast<size_t>(l*width + 8*b+k)] = rows[k][8*b+l];
+			}
+		}
+	}
+
+	// Y' = C*Z' = (C*X*C')'
+	const float *zt[8];
+	for (int i=0; i<8; i++) {
+		zt[i] = &coefs[static_cast<size_t>(i*width)];
+	}
+	conv.dctColumns(zt, &tmp[0], width, basis, 8*nblocks);
+	coefs.swap(tmp);
+
+	// Sums and sums of squares of each 4-sample half row, for the top and bottom quadrants
+	float *top_sum = &sums[0];
+	float *top_sq  = top_sum + 2*nblocks;
+	float *bot_sum = top_sq  + 2*nblocks;
+	float *bot_sq  = bot_sum + 2*nblocks;
+	for (int h=0; h<2*nblocks; h++) {
+		float s[2] = {0.0f, 0.0f};
+		float q[2] = {0.0f, 0.0f};
+		for (int i=0; i<8; i++) {
+			const float *p = src[i] + 4*h;
+			for (int j=0; j<4; j++) {
+				s[i/4] += p[j];
+				q[i/4] += p[j]*p[j];
+			}
+		}
+		top_sum[h] = s[0];
+		top_sq[h]  = q[0];
+		bot_sum[h] = s[1];
+		bot_sq[h]  = q[1];
+	}
+
+	for (int b=0; b<nblocks; b++) {
+		int l = 2*b;
+		int r = 2*b+1;
+		// pop=vari(z);
+		var[static_cast<size_t>(b)] = vari(top_sum[l]+top_sum[r]+bot_sum[l]+bot_sum[r], top_sq[l]+top_sq[r]+bot_sq[l]+bot_sq[r], 64.0f);
+		// vari(z(1:4,1:4))+vari(z(1:4,5:8))+vari(z(5:8,5:8))+vari(z(5:8,1:4))
+		qvar[static_cast<size_t>(b)] = vari(top_sum[l], top_sq[l], 16.0f) + vari(top_sum[r], top_sq[r], 16.0f)
+			+ vari(bot_sum[r], bot_sq[r], 16.0f) + vari(bot_sum[l], bot_sq[l], 16.0f);
+	}
+}
+
+int BlockDCT::blocks() const
+{
+	return nblocks;
+}
+
+const float* BlockDCT::row(int l) const
+{
+	return &coefs[static_cast<size_t>(l*width)];
+}
+
+const float* BlockDCT::variance() const
+{
+	return &var[0];
+}
+
+const float* BlockDCT::quadrantVariance() const
+{
+	return &qvar[0];
+}
@@ -0,0 +1,441 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include "Evaluator.hpp"
+#include "Simd.hpp"
+
+Evaluator::Evaluator(int h, int w, const bool metrics[METRIC_SIZE], int bitdepth) :
+	psnr(NULL), ssim(NULL), msssim(NULL), vifp(NULL), phvs(NULL), pool(NULL), map_size(0), frames(0), warmup(0)
+{
+	for (int m=0; m<METRIC_SIZE; m++) {
+		enabled[m] = metrics[m];
+	}
+
+	if (enabled[METRIC_PSNR]) {
+		psnr = new PSNR(h, w, bitdepth);
+	}
+	// SSIM comes for free with MS-SSIM
+	if (enabled[METRIC_SSIM] && !enabled[METRIC_MSSSIM]) {
+		ssim = new SSIM(h, w);
+	}
+	if (enabled[METRIC_MSSSIM]) {
+		msssim = new MSSSIM(h, w);
+	}
+	if (enabled[METRIC_VIFP]) {
+		vifp = new VIFP(h, w);
+	}
+	if (enabled[METRIC_PSNRHVS] || enabled[METRIC_PSNRHVSM]) {
+		phvs = new PSNRHVS(h, w);
+	}
+
+	// PSNR is computed on the integer samples directly
+	// The other metrics have constants tuned for the 8-bit range, samples are scaled down to it
+	scale = 1.0 / (1 << (bitdepth-8));
+	needs_float = ssim != NULL || msssim != NULL || vifp != NULL || phvs != NULL;
+	if (needs_float) {
+		original_frame = cv::Mat(h, w, CV_32F);
+		processed_frame = cv::Mat(h, w, CV_32F);
+	}
+
+	for (int m=0; m<MAP_SIZE; m++) {
+		map_layout[m].block = 0;
+		map_layout[m].rows = 0;
+		map_layout[m].cols = 0;
+	}
+	if (ssim != NULL) {
+		map_layout[MAP_SSIM].block = SSIM::MAP_BLOCK;
+		map_layout[MAP_SSIM].rows = ssim->mapRows();
+		map_layout[MAP_SSIM].cols = ssim->mapCols();
+	}
+	else if (msssim != NULL && enabled[METRIC_SSIM]) {
+		map_layout[MAP_SSIM].block = SSIM::MAP_BLOCK;
+		map_layout[MAP_SSIM].rows = msssim->mapRows();
+		map_layout[MAP_SSIM].cols = msssim->mapCols();
+	}
+	if (enabled[METRIC_PSNRHVSM]) {
+		map_layout[MAP_PSNRHVSM].block = 8;
+		map_layout[MAP_PSNRHVSM].rows = h/8;
+		map_layout[MAP_PSNRHVSM].cols = w/8;
+	}
+	for (int m=0; m<MAP_SIZE; m++) {
+		map_offset[m] = map_size;
+		map_size += map_layout[m].rows*map_layout[m].cols;
+	}
+}
+
+Evaluator::~Evaluator()
+{
+	delete psnr;
+	delete ssim;
+	delete msssim;
+	delete vifp;
+	delete phvs;
+}
+
+void Evaluator::compute(const cv::Mat& original, const cv::Mat& processed, float result[METRIC_SIZE], float *maps)
+{
+	begin();
+	setMaps(maps);
+
+	// Each stage is timed from the end of the previous one
+	StageTimer timer(profile);
+
+	if (isIdentical(original, processed)) {
+		setIdentical(result, maps);
+		if (vifp != NULL) {
+			convert(original, original_frame);
+			timer.lap(STAGE_CONVERT);
+			result[METRIC_VIFP] = vifp->compute(original_frame, original_frame);
+			timer.lap(STAGE_VIFP);
+		}
+		return;
+	}
+
+	// Compute PSNR
+	if (psnr != NULL) {
+		result[METRIC_PSNR] = psnr->compute(original, processed);
+		timer.lap(STAGE_PSNR);
+	}
+
+	if (!needs_float) {
+		return;
+	}
+	convert(original, original_frame);
+	convert(processed, processed_frame);
+	timer.lap(STAGE_CONVERT);
+
+	// Compute SSIM and MS-SSIM
+	if (ssim != NULL) {
+		result[METRIC_SSIM] = ssim->compute(original_frame, processed_frame);
+		timer.lap(STAGE_SSIM);
+	}
+	if (msssim != NULL) {
+		msssim->compute(original_frame, processed_frame);
+		timer.lap(STAGE_MSSSIM);
+		if (enabled[METRIC_SSIM]) {
+			result[METRIC_SSIM] = msssim->getSSIM();
+		}
+		result[METRIC_MSSSIM] = msssim->getMSSSIM();
+	}
+
+	// Compute VIFp
+	if (vifp != NULL) {
+		result[METRIC_VIFP] = vifp->compute(original_frame, processed_frame);
+		timer.lap(STAGE_VIFP);
+	}
+
+	// Compute PSNR-HVS and PSNR-HVS-M
+	if (phvs != NULL) {
+		phvs->compute(original_frame, processed_frame);
+		timer.lap(STAGE_PSNRHVS);
+		if (enabled[METRIC_PSNRHVS]) {
+			result[METRIC_PSNRHVS] = phvs->getPSNRHVS();
+		}
+		if (enabled[METRIC_PSNRHVSM]) {
+			result[METRIC_PSNRHVSM] = phvs->getPSNRHVSM();
+		}
+	}
+}
+
+void Evaluator::setReference(const cv::Mat& original)
+{
+	begin();
+
+	StageTimer timer(profile);
+
+	reference = original;
+	if (psnr != NULL) {
+		psnr->setReference(original);
+	}
+
+	if (!needs_float) {
+		return;
+	}
+	convert(original, original_frame);
+	timer.lap(STAGE_CONVERT);
+
+	if (ssim != NULL) {
+		ssim->setReference(original_frame);
+		timer.lap(STAGE_SSIM);
+	}
+	if (msssim != NULL) {
+		msssim->setReference(original_frame);
+		timer.lap(STAGE_MSSSIM);
+	}
+	if (vifp != NULL) {
+		vifp->setReference(original_frame);
+		timer.lap(STAGE_VIFP);
+	}
+	if (phvs != NULL) {
+		phvs->setReference(original_frame);
+		timer.lap(STAGE_PSNRHVS);
+	}
+}
+
+void Evaluator::compare(const cv::Mat& processed, float result[METRIC_SIZE], float *maps)
+{
+	setMaps(maps);
+	StageTimer timer(profile);
+
+	if (isIdentical(reference, processed)) {
+		// original_frame still holds the reference
+		setIdentical(result, maps);
+		if (vifp != NULL) {
+			result[METRIC_VIFP] = vifp->compare(original_frame);
+			timer.lap(STAGE_VIFP);
+		}
+		return;
+	}
+
+	// Compute PSNR
+	if (psnr != NULL) {
+		result[METRIC_PSNR] = psnr->compare(processed);
+		timer.lap(STAGE_PSNR);
+	}
+
+	if (!needs_float) {
+		return;
+	}
+	convert(processed, processed_frame);
+	timer.lap(STAGE_CONVERT);
+
+	// Compute SSIM and MS-SSIM
+	if (ssim != NULL) {
+		result[METRIC_SSIM] = ssim->compare(processed_frame);
+		timer.lap(STAGE_SSIM);
+	}
+	if (msssim != NULL) {
+		msssim->compare(processed_frame);
+		timer.lap(STAGE_MSSSIM);
+		if (enabled[METRIC_SSIM]) {
+			result[METRIC_SSIM] = msssim->getSSIM();
+		}
+		result[METRIC_MSSSIM] = msssim->getMSSSIM();
+	}
+
+	// Compute VIFp
+	if (vifp != NULL) {
+		result[METRIC_VIFP] = vifp->compare(processed_frame);
+		timer.lap(STAGE_VIFP);
+	}
+
+	// Compute PSNR-HVS and PSNR-HVS-M
+	if (phvs != NULL) {
+		phvs->compare(processed_frame);
+		timer.lap(STAGE_PSNRHVS);
+		if (enabled[METRIC_PSNRHVS]) {
+			result[METRIC_PSNRHVS] = phvs->getPSNRHVS();
+		}
+		if (enabled[METRIC_PSNRHVSM]) {
+			result[METRIC_PSNRHVSM] = phvs->getPSNRHVSM();
+		}
+	}
+}
+
+void Evaluator::getProfile(Profile& total) const
+{
+	total.merge(profile);
+	if (frames > 1) {
+		total.recordAllocations(allocations()-warmup);
+	}
+}
+
+void Evaluator::getMapLayout(MapLayout layout[MAP_SIZE]) const
+{
+	for (int m=0; m<MAP_SIZE; m++) {
+		layout[m] = map_layout[m];
+	}
+}
+
+int Evaluator::getMapSize() const
+{
+	return map_size;
+}
+
+const char* Evaluator::checkSize(int h, int w, const bool metrics[METRIC_SIZE])
+{
+	// Check size for VIFp downsampling
+	if (metrics[METRIC_VIFP] && (h % 8 != 0 || w % 8 != 0)) {
+		return "VIFp: 'height' and 'width' have to be multiple of 8";
+	}
+	// Check size for MS-SSIM downsampling
+	if (metrics[METRIC_MSSSIM] && (h % 16 != 0 || w % 16 != 0)) {
+		return "MS-SSIM: 'height' and 'width' have to be multiple of 16";
+	}
+	// Check size for the 11x11 window of SSIM, at the coarsest level of MS-SSIM
+	if (metrics[METRIC_MSSSIM] && (h < 11*16 || w < 11*16)) {
+		return "SSIM: 'height' and 'width' have to be at least 176";
+	}
+	if (metrics[METRIC_SSIM] && (h < 11 || w < 11)) {
+		return "SSIM: 'height' and 'width' have to be at least 11";
+	}
+	// Check size for the 3x3 window of VIFp at the coarsest scale
+	if (metrics[METRIC_VIFP] && (h < 72 || w < 72)) {
+		return "VIFp: 'height' and 'width' have to be at least 72";
+	}
+	// Check size for PSNR-HVS 8x8 blocks
+	if ((metrics[METRIC_PSNRHVS] || metrics[METRIC_PSNRHVSM]) && (h % 8 != 0 || w % 8 != 0)) {
+		return "PSNR-HVS: 'height' and 'width' have to be multiple of 8";
+	}
+	return NULL;
+}
+
+void Evaluator::begin()
+{
+	// The metrics size their buffers during the first frame
+	if (++frames == 2) {
+		warmup = allocations();
+	}
+}
+
+void Evaluator::setPool(ThreadPool *p)
+{
+	pool = p;
+	if (psnr != NULL) {
+		psnr->setPool(pool);
+	}
+	if (ssim != NULL) {
+		ssim->setPool(pool);
+	}
+	if (msssim != NULL) {
+		msssim->setPool(pool);
+	}
+	if (vifp != NULL) {
+		vifp->setPool(pool);
+	}
+	if (phvs != NULL) {
+		phvs->setPool(pool);
+	}
+}
+
+void Evaluator::setMaps(float *maps)
+{
+	float *ssim_map = maps != NULL && map_layout[MAP_SSIM].rows > 0 ? maps+map_offset[MAP_SSIM] : NULL;
+	float *phvs_map = maps != NULL && map_layout[MAP_PSNRHVSM].rows > 0 ? maps+map_offset[MAP_PSNRHVSM] : NULL;
+
+	if (ssim != NULL) {
+		ssim->setMap(ssim_map);
+	}
+	if (msssim != NULL) {
+		msssim->setMap(ssim_map);
+	}
+	if (phvs != NULL) {
+		phvs->setMap(phvs_map);
+	}
+}
+
+bool Evaluator::isIdentical(const cv::Mat& a, const cv::Mat& b)
+{
+	// Processed frames usually differ from the first row
+	size_t bytes = static_cast<size_t>(a.cols)*a.elemSize();
+	for (int y=0; y<a.rows; y++) {
+		if (memcmp(a.ptr(y), b.ptr(y), bytes) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void Evaluator::setIdentical(float result[METRIC_SIZE], float *maps)
+{
+	profile.count(COUNTER_IDENTICAL);
+
+	// Zero mean squared error
+	if (psnr != NULL) {
+		result[METRIC_PSNR] = std::numeric_limits<float>::infinity();
+	}
+	// The SSIM index and contrast comparison function are 1 at each sample, at each level
+	if (enabled[METRIC_SSIM]) {
+		result[METRIC_SSIM] = 1.0f;
+	}
+	if (enabled[METRIC_MSSSIM]) {
+		result[METRIC_MSSSIM] = 1.0f;
+	}
+	// No error in any block
+	if (enabled[METRIC_PSNRHVS]) {
+		result[METRIC_PSNRHVS] = PSNRHVS::MAX_INDEX;
+	}
+	if (enabled[METRIC_PSNRHVSM]) {
+		result[METRIC_PSNRHVSM] = PSNRHVS::MAX_INDEX;
+	}
+
+	if (maps != NULL) {
+		const MapLayout& ssim_map = map_layout[MAP_SSIM];
+		const MapLayout& phvs_map = map_layout[MAP_PSNRHVSM];
+		std::fill(maps+map_offset[MAP_SSIM], maps+map_offset[MAP_SSIM]+ssim_map.rows*ssim_map.cols, 1.0f);
+		std::fill(maps+map_offset[MAP_PSNRHVSM], maps+map_offset[MAP_PSNRHVSM]+phvs_map.rows*phvs_map.cols, 0.0f);
+	}
+}
+
+void Evaluator::convert(const cv::Mat& src, cv::Mat& dst) const
+{
+	// Same as src.convertTo(dst, CV_32F, scale): the scale is a power of two, the products are exact
+	const SimdKernels& kernels = Simd::kernels();
+	float s = static_cast<float>(scale);
+	const int ROWS = 64;	// rows of each band
+	ThreadPool::Body body = [&](int i, int) {
+		for (int y=i*ROWS; y<std::min((i+1)*ROWS, src.rows); y++) {
+			if (src.depth() == CV_8U) {
+				kernels.convert8(src.ptr<uint8_t>(y), dst.ptr<float>(y), s, src.cols);
+			}
+			else {
+				kernels.convert16(src.ptr<uint16_t>(y), dst.ptr<float>(y), s, src.cols);
+			}
+		}
+	};
+
+	int nbands = (src.rows+ROWS-1) / ROWS;
+	if (pool != NULL) {
+		pool->parallelFor(nbands, body);
+	}
+	else {
+		for (int i=0; i<nbands; i++) {
+			body(i, 0);
+		}
+	}
+}
+
+uint64_t Evaluator::allocations() const
+{
+	uint64_t n = 0;
+	if (psnr != NULL) {
+		n += psnr->getAllocations();
+	}
+	if (ssim != NULL) {
+		n += ssim->getAllocations();
+	}
+	if (msssim != NULL) {
+		n += msssim->getAllocations();
+	}
+	if (vifp != NULL) {
+		n += vifp->getAllocations();
+	}
+	if (phvs != NULL) {
+		n += phvs->getAllocations();
+	}
+	return n;
+}
@@ -0,0 +1,127 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <string.h>
+#include <algorithm>
+#include "FrameCache.hpp"
+#include "Simd.hpp"
+
+FrameCache::FrameCache(int capacity) : clock(0)
+{
+	entries.resize(static_cast<size_t>(capacity));
+	for (size_t i=0; i<entries.size(); i++) {
+		entries[i].used = 0;
+	}
+}
+
+bool FrameCache::isEnabled() const
+{
+	return !entries.empty();
+}
+
+void FrameCache::setMapSize(int size)
+{
+	for (size_t i=0; i<entries.size(); i++) {
+		entries[i].maps.assign(static_cast<size_t>(size), 0.0f);
+	}
+}
+
+bool FrameCache::find(uint64_t original, uint64_t processed, float result[METRIC_SIZE], float *maps)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (size_t i=0; i<entries.size(); i++) {
+		Entry& entry = entries[i];
+		if (entry.used != 0 && entry.original == original && entry.processed == processed) {
+			entry.used = ++clock;
+			for (int m=0; m<METRIC_SIZE; m++) {
+				result[m] = entry.result[m];
+			}
+			if (maps != NULL) {
+				std::copy(entry.maps.begin(), entry.maps.end(), maps);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void FrameCache::insert(uint64_t original, uint64_t processed, const float result[METRIC_SIZE], const float *maps)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (entries.empty()) {
+		return;
+	}
+
+	// Empty entries have the oldest use
+	size_t oldest = 0;
+	for (size_t i=1; i<entries.size(); i++) {
+		if (entries[i].used < entries[oldest].used) {
+			oldest = i;
+		}
+	}
+
+	Entry& entry = entries[oldest];
+	entry.original = original;
+	entry.processed = processed;
+	entry.used = ++clock;
+	for (int m=0; m<METRIC_SIZE; m++) {
+		entry.result[m] = result[m];
+	}
+	if (maps != NULL) {
+		std::copy(maps, maps+entry.maps.size(), entry.maps.begin());
+	}
+}
+
+uint64_t FrameCache::fingerprint(const cv::Mat& component)
+{
+	const SimdKernels& kernels = Simd::kernels();
+	const int BLOCK = 8*HASH_LANES;
+	int bytes = component.cols*static_cast<int>(component.elemSize());
+	int nblocks = bytes/BLOCK;
+
+	uint64_t state[HASH_LANES];
+	for (int l=0; l<HASH_LANES; l++) {
+		state[l] = HASH_PRIME1*static_cast<uint64_t>(l+1);
+	}
+	for (int y=0; y<component.rows; y++) {
+		const uint8_t *row = component.ptr<uint8_t>(y);
+		kernels.hashBlocks(row, nblocks, state);
+		// The end of the row is padded with zeros
+		if (nblocks*BLOCK < bytes) {
+			uint8_t tail[BLOCK];
+			memset(tail, 0, sizeof(tail));
+			memcpy(tail, row+nblocks*BLOCK, static_cast<size_t>(bytes-nblocks*BLOCK));
+			kernels.hashBlocks(tail, 1, state);
+		}
+	}
+
+	// Fold the lanes into 64 bits, along with the dimensions
+	// Each step is a bijection of h, components differing in a single lane always differ
+	uint64_t h = static_cast<uint64_t>(component.rows) << 32 | static_cast<uint64_t>(bytes);
+	for (int l=0; l<HASH_LANES; l++) {
+		h = (h ^ state[l])*0x9E3779B97F4A7C15ull;
+		h ^= h >> 29;
+	}
+	return h;
+}
@@ -0,0 +1,311 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <algorithm>
+#include "FrameEngine.hpp"
+
+FrameEngine::FrameEngine(const int height[PLANE_SIZE], const int width[PLANE_SIZE], int planes, int bitdepth,
+	int nbvideos, const bool metrics[METRIC_SIZE], int nbthreads, const Writer& w) :
+	nbplanes(planes), writer(w), next_acquire(0), next_submit(0), next_write(0), live(false), intra(false)
+{
+	for (int p=0; p<nbplanes; p++) {
+		for (int i=0; i<nbthreads; i++) {
+			evaluators[p].push_back(new Evaluator(height[p], width[p], metrics, bitdepth));
+		}
+		caches[p] = new FrameCache(0);
+	}
+
+	// Two slots per worker so that reading never waits for the slowest frame
+	slots.resize(static_cast<size_t>(2*nbthreads));
+	int type = bitdepth > 8 ? CV_16U : CV_8U;
+	for (size_t i=0; i<slots.size(); i++) {
+		slots[i].processed.resize(static_cast<size_t>(nbvideos));
+		for (int p=0; p<nbplanes; p++) {
+			slots[i].original[p] = cv::Mat(height[p], width[p], type);
+			for (int v=0; v<nbvideos; v++) {
+				slots[i].processed[static_cast<size_t>(v)].component[p] = cv::Mat(height[p], width[p], type);
+			}
+		}
+		for (int v=0; v<nbvideos; v++) {
+			slots[i].processed[static_cast<size_t>(v)].skipped = false;
+		}
+		slots[i].pending = 0;
+		slots[i].submitted = 0.0;
+		slots[i].done = false;
+	}
+
+	pool = new ThreadPool(nbthreads);
+}
+
+FrameEngine::~FrameEngine()
+{
+	// Joins the workers before releasing their evaluators
+	delete pool;
+	for (int p=0; p<nbplanes; p++) {
+		for (size_t i=0; i<evaluators[p].size(); i++) {
+			delete evaluators[p][i];
+		}
+		delete caches[p];
+	}
+}
+
+FrameSlot* FrameEngine::acquire(int frame)
+{
+	long depth = static_cast<long>(slots.size());
+
+	// Write out what is ready, and wait for the slot to be released
+	double start = Profile::now();
+	write(next_acquire-depth+1, true);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		profile.record(STAGE_WAIT, Profile::now()-start);
+	}
+	write(next_acquire, false);
+
+	FrameSlot *slot = &slots[static_cast<size_t>(next_acquire % depth)];
+	slot->frame = frame;
+	{
+		// Live workers check the slots that follow the one they finished
+		std::lock_guard<std::mutex> lock(mutex);
+		slot->done = false;
+	}
+	next_acquire++;
+	return slot;
+}
+
+void FrameEngine::submit(FrameSlot* slot)
+{
+	slot->pending = nbplanes;
+	slot->submitted = Profile::now();
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		next_submit++;
+	}
+	for (int p=0; p<nbplanes; p++) {
+		pool->run([this, slot, p](int id) {
+			size_t index = intra ? static_cast<size_t>(slot-&slots[0]) : static_cast<size_t>(id);
+			Evaluator *evaluator = evaluators[p][index];
+			FrameCache *cache = caches[p];
+			for (size_t v=0; v<slot->processed.size(); v++) {
+				for (int m=0; m<METRIC_SIZE; m++) {
+					slot->processed[v].result[p][m] = 0.0f;
+				}
+				slot->processed[v].cached[p] = false;
+			}
+
+			// Look up the pairs of components in the cache
+			uint64_t original = 0;
+			double hash_time = 0.0;
+			if (cache->isEnabled()) {
+				double start = Profile::now();
+				original = FrameCache::fingerprint(slot->original[p]);
+				for (size_t v=0; v<slot->processed.size(); v++) {
+					ProcessedFrame& processed = slot->processed[v];
+					if (processed.skipped) {
+						continue;
+					}
+					processed.fingerprint[p] = FrameCache::fingerprint(processed.component[p]);
+					processed.cached[p] = cache->find(original, processed.fingerprint[p], processed.result[p], maps(processed, p));
+				}
+				hash_time = Profile::now()-start;
+			}
+
+			if (slot->processed.size() == 1) {
+				if (!slot->processed[0].cached[p] && !slot->processed[0].skipped) {
+					evaluator->compute(slot->original[p], slot->processed[0].component[p], slot->processed[0].result[p],
+						maps(slot->processed[0], p));
+				}
+			}
+			else {
+				// The statistics of the original component are shared by all processed videos
+				bool referenced = false;
+				for (size_t v=0; v<slot->processed.size(); v++) {
+					if (slot->processed[v].cached[p] || slot->processed[v].skipped) {
+						continue;
+					}
+					if (!referenced) {
+						evaluator->setReference(slot->original[p]);
+						referenced = true;
+					}
+					evaluator->compare(slot->processed[v].component[p], slot->processed[v].result[p],
+						maps(slot->processed[v], p));
+				}
+			}
+
+			if (cache->isEnabled()) {
+				for (size_t v=0; v<slot->processed.size(); v++) {
+					ProcessedFrame& processed = slot->processed[v];
+					if (!processed.cached[p] && !processed.skipped) {
+						cache->insert(original, processed.fingerprint[p], processed.result[p], maps(processed, p));
+					}
+				}
+			}
+
+			bool done;
+			long submitted;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (cache->isEnabled()) {
+					profile.record(STAGE_HASH, hash_time);
+					for (size_t v=0; v<slot->processed.size(); v++) {
+						if (slot->processed[v].skipped) {
+							continue;
+						}
+						profile.count(slot->processed[v].cached[p] ? COUNTER_CACHE_HIT : COUNTER_CACHE_MISS);
+					}
+				}
+				done = slot->done = --slot->pending == 0;
+				if (done) {
+					profile.record(STAGE_FRAME, Profile::now()-slot->submitted);
+				}
+				submitted = next_submit;
+			}
+			if (done) {
+				cond.notify_all();
+				// Tasks start in submission order: a worker waiting here to write
+				// never holds back the computation of the frames before its own
+				if (live) {
+					write(submitted, false);
+				}
+			}
+		});
+	}
+}
+
+void FrameEngine::poll()
+{
+	write(next_acquire, false);
+}
+
+void FrameEngine::setLive(bool enable)
+{
+	live = enable;
+}
+
+void FrameEngine::setIntra(bool enable)
+{
+	intra = enable;
+	if (!intra) {
+		return;
+	}
+
+	// Every slot is spread over all the workers: a second slot is read while the first one
+	// is computed, more slots would only multiply the buffers of each worker in each Evaluator
+	size_t nbslots = std::min(slots.size(), evaluators[PLANE_Y].size());
+	nbslots = std::min(nbslots, static_cast<size_t>(INTRA_SLOTS));
+	slots.resize(nbslots);
+	for (int p=0; p<nbplanes; p++) {
+		for (size_t i=nbslots; i<evaluators[p].size(); i++) {
+			delete evaluators[p][i];
+		}
+		evaluators[p].resize(nbslots);
+		for (size_t i=0; i<nbslots; i++) {
+			evaluators[p][i]->setPool(pool);
+		}
+	}
+}
+
+void FrameEngine::setMaps(bool enable)
+{
+	size_t size = enable ? static_cast<size_t>(evaluators[PLANE_Y][0]->getMapSize()) : 0;
+	for (size_t i=0; i<slots.size(); i++) {
+		for (size_t v=0; v<slots[i].processed.size(); v++) {
+			slots[i].processed[v].maps.assign(size, 0.0f);
+		}
+	}
+	caches[PLANE_Y]->setMapSize(static_cast<int>(size));
+}
+
+void FrameEngine::setCache(int capacity)
+{
+	for (int p=0; p<nbplanes; p++) {
+		delete caches[p];
+		caches[p] = new FrameCache(capacity);
+	}
+	caches[PLANE_Y]->setMapSize(static_cast<int>(slots[0].processed[0].maps.size()));
+}
+
+int FrameEngine::getDepth() const
+{
+	return static_cast<int>(slots.size());
+}
+
+void FrameEngine::getMapLayout(MapLayout layout[MAP_SIZE]) const
+{
+	evaluators[PLANE_Y][0]->getMapLayout(layout);
+}
+
+void FrameEngine::flush()
+{
+	write(next_acquire, true);
+}
+
+void FrameEngine::getProfile(Profile& total) const
+{
+	total.merge(profile);
+	for (int p=0; p<nbplanes; p++) {
+		for (size_t i=0; i<evaluators[p].size(); i++) {
+			evaluators[p][i]->getProfile(total);
+		}
+	}
+}
+
+void FrameEngine::write(long until, bool block)
+{
+	long depth = static_cast<long>(slots.size());
+
+	std::unique_lock<std::mutex> lock_writing(writing);
+	while (next_write < until) {
+		FrameSlot *slot = &slots[static_cast<size_t>(next_write % depth)];
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (!slot->done) {
+				if (!block) {
+					return;
+				}
+				// Live workers write out the slots they finish: they cannot be kept
+				// waiting for 'writing', the slot may be written by one of them meanwhile
+				lock_writing.unlock();
+				while (!slot->done) {
+					cond.wait(lock);
+				}
+				lock.unlock();
+				lock_writing.lock();
+				continue;
+			}
+		}
+		for (size_t v=0; v<slot->processed.size(); v++) {
+			if (slot->processed[v].skipped) {
+				continue;
+			}
+			writer(slot->frame, static_cast<int>(v), slot->processed[v].result, maps(slot->processed[v], PLANE_Y));
+		}
+		next_write++;
+	}
+}
+
+float* FrameEngine::maps(ProcessedFrame& processed, int plane)
+{
+	return plane == PLANE_Y && !processed.maps.empty() ? &processed.maps[0] : NULL;
+}
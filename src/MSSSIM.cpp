@@ -43,48 +43,89 @@ MSSSIM::MSSSIM(int h, int w) : SSIM(h, w)
 
 float MSSSIM::compute(const cv::Mat& original, const cv::Mat& processed)
 {
-	double mssim[NLEVS];
-	double mcs[NLEVS];
-
-	cv::Mat im1[NLEVS];
-	cv::Mat im2[NLEVS];
-	
-	int w = original.cols;
-	int h = original.rows;
-	
-	original.copyTo(im1[0]);
-	processed.copyTo(im2[0]);
-	
+	Pair pairs[NLEVS];
+
+	const cv::Mat *im1 = &original;
+	const cv::Mat *im2 = &processed;
+
+	// The pyramids are built first, so that all the levels are computed at once
 	for (int l=0; l<NLEVS; l++) {
-		// [mssim_array(l) ssim_map_array{l} mcs_array(l) cs_map_array{l}] = ssim_index_new(im1, im2, K, window);
-		cv::Scalar res = SSIM::computeSSIM(im1[l], im2[l]);
-		mssim[l] = res.val[0];
-		mcs[l] = res.val[1];
+		Pair pair = {im1, NULL, im2, l == 0 ? map : NULL, cv::Scalar(), 0, 0, 0};
+		pairs[l] = pair;
 
 		if (l < NLEVS-1) {
-			w /= 2;
-			h /= 2;
-			im1[l+1] = cv::Mat(h,w,CV_32F);
-			im2[l+1] = cv::Mat(h,w,CV_32F);
-			
 			// filtered_im1 = filter2(downsample_filter, im1, 'valid');
 			// im1 = filtered_im1(1:2:M-1, 1:2:N-1);
-			cv::resize(im1[l], im1[l+1], cv::Size(w,h), 0, 0, cv::INTER_LINEAR);
+			downsample(*im1, pyramid1[l+1]);
+			im1 = &pyramid1[l+1];
 			// filtered_im2 = filter2(downsample_filter, im2, 'valid');
 			// im2 = filtered_im2(1:2:M-1, 1:2:N-1);
-			cv::resize(im2[l], im2[l+1], cv::Size(w,h), 0, 0, cv::INTER_LINEAR);
+			downsample(*im2, pyramid2[l+1]);
+			im2 = &pyramid2[l+1];
 		}
 	}
 
-	ssim = mssim[0];
+	combine(pairs);
 
-	// overall_mssim = prod(mcs_array(1:level-1).^weight(1:level-1))*mssim_array(level);
-	msssim = mssim[NLEVS-1];
-	for (int l=0; l<NLEVS-1; l++)	msssim *= pow(mcs[l], WEIGHT[l]);
+	return float(msssim);
+}
+
+void MSSSIM::setReference(const cv::Mat& original)
+{
+	cv::Mat im1 = original;
+
+	for (int l=0; l<NLEVS; l++) {
+		prepareSSIM(im1, levels[l]);
+
+		if (l < NLEVS-1) {
+			// Each level keeps a reference to its image
+			downsample(im1, ref_pyramid[l+1]);
+			im1 = ref_pyramid[l+1];
+		}
+	}
+}
+
+float MSSSIM::compare(const cv::Mat& processed)
+{
+	Pair pairs[NLEVS];
+
+	const cv::Mat *im2 = &processed;
+
+	for (int l=0; l<NLEVS; l++) {
+		Pair pair = {NULL, &levels[l], im2, l == 0 ? map : NULL, cv::Scalar(), 0, 0, 0};
+		pairs[l] = pair;
+
+		if (l < NLEVS-1) {
+			downsample(*im2, pyramid2[l+1]);
+			im2 = &pyramid2[l+1];
+		}
+	}
+
+	combine(pairs);
 
 	return float(msssim);
 }
 
+void MSSSIM::downsample(const cv::Mat& src, cv::Mat& dst)
+{
+	int w = src.cols / 2;
+	int h = src.rows / 2;
+	allocate(dst, h, w);
+	cv::resize(src, dst, cv::Size(w,h), 0, 0, cv::INTER_LINEAR);
+}
+
+void MSSSIM::combine(Pair pairs[NLEVS])
+{
+	// [mssim_array(l) ssim_map_array{l} mcs_array(l) cs_map_array{l}] = ssim_index_new(im1, im2, K, window);
+	SSIM::computeSSIM(pairs, NLEVS);
+
+	ssim = pairs[0].res.val[0];
+
+	// overall_mssim = prod(mcs_array(1:level-1).^weight(1:level-1))*mssim_array(level);
+	msssim = pairs[NLEVS-1].res.val[0];
+	for (int l=0; l<NLEVS-1; l++)	msssim *= pow(pairs[l].res.val[1], WEIGHT[l]);
+}
+
 float MSSSIM::getSSIM()
 {
 	return float(ssim);
@@ -22,9 +22,12 @@
 // maintenance, support, updates, enhancements, or modifications.
 //
 
+#include <algorithm>
 #include "Metric.hpp"
 
-Metric::Metric(int h, int w)
+const int Metric::BAND;
+
+Metric::Metric(int h, int w) : allocations(0), pool(NULL)
 {
 	height = h;
 	width = w;
@@ -38,7 +41,82 @@ Metric::~Metric()
 void Metric::applyGaussianBlur(const cv::Mat& src, cv::Mat& dst, int ksize, double sigma)
 {
 	int invalid = (ksize-1)/2;
-	cv::Mat tmp(src.rows, src.cols, CV_32F);
-	cv::GaussianBlur(src, tmp, cv::Size(ksize,ksize), sigma);
-	tmp(cv::Range(invalid, tmp.rows-invalid), cv::Range(invalid, tmp.cols-invalid)).copyTo(dst);
+	allocate(blurred, src.rows, src.cols);
+	cv::GaussianBlur(src, blurred, cv::Size(ksize,ksize), sigma);
+	blurred(cv::Range(invalid, blurred.rows-invalid), cv::Range(invalid, blurred.cols-invalid)).copyTo(dst);
+}
+
+uint64_t Metric::getAllocations() const
+{
+	return allocations;
+}
+
+void Metric::setPool(ThreadPool *p)
+{
+	pool = p;
+}
+
+int Metric::bands(int rows) const
+{
+	return pool != NULL ? std::max((rows+BAND-1) / BAND, 1) : 1;
+}
+
+void Metric::band(int i, int rows, int& first, int& last) const
+{
+	if (pool == NULL) {
+		first = 0;
+		last = rows;
+	}
+	else {
+		first = i*BAND;
+		last = std::min(first+BAND, rows);
+	}
+}
+
+int Metric::runners() const
+{
+	return pool != NULL ? pool->size()+1 : 1;
+}
+
+void Metric::parallel(int n, const ThreadPool::Body& body)
+{
+	if (pool != NULL && n > 1) {
+		pool->parallelFor(n, body);
+	}
+	else {
+		for (int i=0; i<n; i++) {
+			body(i, 0);
+		}
+	}
+}
+
+void Metric::allocate(cv::Mat& m, int rows, int cols)
+{
+	if (m.rows == rows && m.cols == cols && m.type() == CV_32F) {
+		return;
+	}
+	m = cv::Mat(rows, cols, CV_32F);
+	allocations++;
+}
+
+double Metric::sum(const float *data, int n)
+{
+	// Independent partial sums let the compiler vectorize the loop
+	const int LANES = 8;
+	double acc[LANES] = {0};
+	int x = 0;
+	for (; x+LANES<=n; x+=LANES) {
+		for (int l=0; l<LANES; l++) {
+			acc[l] += static_cast<double>(data[x+l]);
+		}
+	}
+	for (; x<n; x++) {
+		acc[0] += static_cast<double>(data[x]);
+	}
+
+	double res = 0.0;
+	for (int l=0; l<LANES; l++) {
+		res += acc[l];
+	}
+	return res;
 }
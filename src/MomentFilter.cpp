@@ -0,0 +1,191 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include "MomentFilter.hpp"
+#include "Simd.hpp"
+
+// dst[x] = sum_t kernel[t]*src[x+t], for x in [0,n)
+// Taps are accumulated in order, one full row at a time, so that the inner loop vectorizes
+// Same as SimdKernels::convolveRow(), for the even positions only: dst[x] = sum_t kernel[t]*src[2*x+t]
+static void convolveRowEven(const float *src, float *dst, const float *kernel, int ksize, int n)
+{
+	const float k0 = kernel[0];
+	for (int x=0; x<n; x++) {
+		dst[x] = k0*src[2*x];
+	}
+	for (int t=1; t<ksize; t++) {
+		const float kt = kernel[t];
+		const float *s = src+t;
+		for (int x=0; x<n; x++) {
+			dst[x] += kt*s[2*x];
+		}
+	}
+}
+
+MomentFilter::MomentFilter(int k, double sigma) :
+	ksize(k), in_cols(0), out_cols(0), next_row(0), selected(0)
+{
+	// Same kernel as cv::GaussianBlur on CV_32F images
+	cv::Mat tmp = cv::getGaussianKernel(ksize, sigma, CV_32F);
+	kernel.resize(static_cast<size_t>(ksize));
+	for (int t=0; t<ksize; t++) {
+		kernel[static_cast<size_t>(t)] = tmp.at<float>(t, 0);
+	}
+}
+
+void MomentFilter::begin(const cv::Mat& i1, const cv::Mat& i2, int row)
+{
+	start(i1, i2, row, (1u << MOMENT_SIZE)-1);
+}
+
+void MomentFilter::beginReference(const cv::Mat& i1, int row)
+{
+	start(i1, i1, row, (1u << MOMENT_MU1) | (1u << MOMENT_SQ1));
+}
+
+void MomentFilter::beginProcessed(const cv::Mat& i1, const cv::Mat& i2, int row)
+{
+	start(i1, i2, row, (1u << MOMENT_MU2) | (1u << MOMENT_SQ2) | (1u << MOMENT_12));
+}
+
+void MomentFilter::start(const cv::Mat& i1, const cv::Mat& i2, int row, unsigned int moments)
+{
+	img1 = i1;
+	img2 = i2;
+	in_cols = img1.cols;
+	out_cols = img1.cols - (ksize-1);
+	next_row = row;
+	selected = moments;
+
+	product.resize(static_cast<size_t>(in_cols));
+	ring.resize(static_cast<size_t>(MOMENT_SIZE*ksize*out_cols));
+	out.resize(static_cast<size_t>(MOMENT_SIZE*out_cols));
+	window.resize(static_cast<size_t>(ksize));
+
+	// Prime the rolling buffer with the first ksize-1 rows of the window
+	for (int y=row; y<row+ksize-1; y++) {
+		filterRow(y);
+	}
+}
+
+void MomentFilter::next()
+{
+	const SimdKernels& conv = Simd::kernels();
+	filterRow(next_row+ksize-1);
+
+	for (int m=0; m<MOMENT_SIZE; m++) {
+		if (!(selected & (1u << m))) {
+			continue;
+		}
+		for (int t=0; t<ksize; t++) {
+			window[static_cast<size_t>(t)] = ringRow(m, next_row+t);
+		}
+		conv.convolveColumn(&window[0], &out[static_cast<size_t>(m*out_cols)], &kernel[0], ksize, out_cols);
+	}
+	next_row++;
+}
+
+void MomentFilter::decimate(const cv::Mat& src, cv::Mat& dst, int first, int last)
+{
+	const SimdKernels& conv = Simd::kernels();
+
+	// The decimated rows are kept in the rolling buffer of the first moment
+	out_cols = dst.cols;
+	selected = 0;
+	ring.resize(static_cast<size_t>(MOMENT_SIZE*ksize*out_cols));
+	window.resize(static_cast<size_t>(ksize));
+	const float *k = &kernel[0];
+
+	if (last < 0) {
+		last = dst.rows;
+	}
+	int y = 2*first;	// next row of src to filter horizontally
+	for (int j=first; j<last; j++) {
+		// Output row j is the vertical filtering of rows 2*j to 2*j+ksize-1
+		for (; y<2*j+ksize; y++) {
+			convolveRowEven(src.ptr<float>(y), ringRow(0, y), k, ksize, out_cols);
+		}
+
+		for (int t=0; t<ksize; t++) {
+			window[static_cast<size_t>(t)] = ringRow(0, 2*j+t);
+		}
+		conv.convolveColumn(&window[0], dst.ptr<float>(j), k, ksize, out_cols);
+	}
+}
+
+int MomentFilter::cols() const
+{
+	return out_cols;
+}
+
+const float* MomentFilter::row(int moment) const
+{
+	return &out[static_cast<size_t>(moment*out_cols)];
+}
+
+void MomentFilter::filterRow(int y)
+{
+	const SimdKernels& conv = Simd::kernels();
+	const float *a = img1.ptr<float>(y);
+	const float *b = img2.ptr<float>(y);
+	float *p = &product[0];
+	const float *k = &kernel[0];
+
+	for (int m=0; m<MOMENT_SIZE; m++) {
+		if (!(selected & (1u << m))) {
+			continue;
+		}
+		const float *src = p;
+		switch (m) {
+		case MOMENT_MU1:
+			src = a;
+			break;
+		case MOMENT_MU2:
+			src = b;
+			break;
+		case MOMENT_SQ1:
+			for (int x=0; x<in_cols; x++) {
+				p[x] = a[x]*a[x];
+			}
+			break;
+		case MOMENT_SQ2:
+			for (int x=0; x<in_cols; x++) {
+				p[x] = b[x]*b[x];
+			}
+			break;
+		default:
+			for (int x=0; x<in_cols; x++) {
+				p[x] = a[x]*b[x];
+			}
+			break;
+		}
+		conv.convolveRow(src, ringRow(m, y), k, ksize, out_cols);
+	}
+}
+
+float* MomentFilter::ringRow(int moment, int y)
+{
+	return &ring[static_cast<size_t>((moment*ksize + y%ksize)*out_cols)];
+}
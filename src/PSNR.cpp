@@ -23,15 +23,73 @@
 //
 
 #include "PSNR.hpp"
+#include "Simd.hpp"
 
-PSNR::PSNR(int h, int w) : Metric(h, w)
+PSNR::PSNR(int h, int w, int bd) : Metric(h, w), bitdepth(bd), band_sse(1)
 {
 }
 
+void PSNR::setPool(ThreadPool *p)
+{
+	Metric::setPool(p);
+	band_sse.resize(static_cast<size_t>(bands(height)));
+}
+
 float PSNR::compute(const cv::Mat& original, const cv::Mat& processed)
 {
-	cv::Mat tmp(height,width,CV_32F);
-	cv::subtract(original, processed, tmp);
-	cv::multiply(tmp, tmp, tmp);
-	return float(10*log10(255*255/cv::mean(tmp).val[0]));
+	if (original.depth() == CV_8U || original.depth() == CV_16U) {
+		// Exact integer sum of squared errors, without conversion to float
+		const SimdKernels& kernels = Simd::kernels();
+		parallel(static_cast<int>(band_sse.size()), [&](int i, int) {
+			int first, last;
+			band(i, height, first, last);
+			uint64_t sse = 0;
+			for (int y=first; y<last; y++) {
+				if (original.depth() == CV_8U) {
+					sse += kernels.squaredError8(original.ptr<uint8_t>(y), processed.ptr<uint8_t>(y), width);
+				}
+				else {
+					sse += kernels.squaredError16(original.ptr<uint16_t>(y), processed.ptr<uint16_t>(y), width, bitdepth);
+				}
+			}
+			band_sse[static_cast<size_t>(i)] = sse;
+		});
+		uint64_t sse = 0;
+		for (size_t i=0; i<band_sse.size(); i++) {
+			sse += band_sse[i];
+		}
+		double mse = static_cast<double>(sse) / (static_cast<double>(width)*height);
+		// Peak value of 255 scaled to the bit depth, as in the HEVC reference software
+		double peak = static_cast<double>(255 << (bitdepth-8));
+		return float(10*log10(peak*peak/mse));
+	}
+
+	double sse = 0.0;
+	for (int y=0; y<height; y++) {
+		const float *a = original.ptr<float>(y);
+		const float *b = processed.ptr<float>(y);
+		for (int x=0; x<width; x++) {
+			float d = a[x]-b[x];
+			sse += static_cast<double>(d*d);
+		}
+	}
+	double mse = sse / (static_cast<double>(width)*height);
+	return float(10*log10(255*255/mse));
+}
+
+void PSNR::setReference(const cv::Mat& original)
+{
+	reference = original;
+}
+
+float PSNR::compare(const cv::Mat& processed)
+{
+	return compute(reference, processed);
+}
+
+float PSNR::maxIndex(int height, int width, int bitdepth)
+{
+	double mse = 1.0 / (static_cast<double>(width)*height);
+	double peak = static_cast<double>(255 << (bitdepth-8));
+	return float(10*log10(peak*peak/mse));
 }
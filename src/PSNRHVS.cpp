@@ -39,6 +39,7 @@
 //   Processing and Quality Metrics for Consumer Electronics, January 2007.
 //
 
+#include <algorithm>
 #include <cfloat>
 #include "PSNRHVS.hpp"
 
@@ -60,8 +61,31 @@ const float PSNRHVS::MASK[8][8] =	{{0.390625f, 0.826446f, 1.000000f, 0.390625f,
 									 {0.041649f, 0.024414f, 0.016437f, 0.013212f, 0.009426f, 0.006830f, 0.006944f, 0.009803f},
 									 {0.019290f, 0.011815f, 0.011080f, 0.010412f, 0.007972f, 0.010000f, 0.009426f, 0.010203f}};
 
-PSNRHVS::PSNRHVS(int h, int w) : Metric(h, w)
+const float PSNRHVS::MAX_INDEX = 100000.0f;
+
+PSNRHVS::PSNRHVS(int h, int w) : Metric(h, w), map(NULL), runner_buffers(1, Runner(w))
+{
+	for (int l=0; l<8; l++) {
+		for (int k=0; k<8; k++) {
+			bool ac = k != 0 || l != 0;
+			csf_t[l][k] = CSF[k][l];
+			mask_t[l][k] = MASK[k][l];
+			ac_t[l][k] = ac ? 1.0f : 0.0f;
+		}
+	}
+
+	size_t nblocks = static_cast<size_t>(h/8)*static_cast<size_t>(w/8);
+	errors1.resize(nblocks);
+	errors2.resize(nblocks);
+}
+
+PSNRHVS::Runner::Runner(int w) : dct_a(w), dct_b(w)
 {
+	size_t nblocks = static_cast<size_t>(w/8);
+	mask_a.resize(nblocks);
+	mask_b.resize(nblocks);
+	lanes1.resize(8*nblocks);
+	lanes2.resize(8*nblocks);
 }
 
 float PSNRHVS::getPSNRHVS()
@@ -74,127 +98,204 @@ float PSNRHVS::getPSNRHVSM()
 	return psnrhvsm;
 }
 
+void PSNRHVS::setMap(float *errors)
+{
+	map = errors;
+}
+
+void PSNRHVS::setPool(ThreadPool *p)
+{
+	Metric::setPool(p);
+	runner_buffers.resize(static_cast<size_t>(runners()), runner_buffers[0]);
+}
+
 float PSNRHVS::compute(const cv::Mat& original, const cv::Mat& processed)
 {
-	float s1 = 0.0f;
-	float s2 = 0.0f;
-	float num = static_cast<float>(width*height);
-	float tmp;
-	cv::Mat a(8,8,CV_32F), b(8,8,CV_32F), a_dct(8,8,CV_32F), b_dct(8,8,CV_32F);
-
-	for (int y=0; y<height; y+=8) {
-		for (int x=0; x<width; x+=8) {
-			// a = img1(y:y+7,x:x+7);
-			a = original(cv::Range(y,y+8),cv::Range(x,x+8));
-			// b = img2(y:y+7,x:x+7);
-			b = processed(cv::Range(y,y+8),cv::Range(x,x+8));
+	// Blocks are processed one strip of 8 rows at a time
+	parallel(bands(height), [&](int i, int r) {
+		Runner& runner = runner_buffers[static_cast<size_t>(r)];
+		const float *dct_rows[8];
+		int first, last;
+		band(i, height, first, last);
+		for (int y=first; y<last; y+=8) {
 			// a_dct = dct2(a);
-			cv::dct(a, a_dct);
-			// b_dct = dct2(b);
-			cv::dct(b, b_dct);
+			runner.dct_a.transform(original, y);
+			// mask_a = maskeff(a,a_dct);
+			maskeff(runner.dct_a, &runner.mask_a[0], &runner.lanes1[0]);
+
+			for (int l=0; l<8; l++) {
+				dct_rows[l] = runner.dct_a.row(l);
+			}
+			compareStrip(processed, y, dct_rows, &runner.mask_a[0], runner);
+		}
+	});
+
+	finish();
+
+	return psnrhvsm;
+}
+
+void PSNRHVS::setReference(const cv::Mat& original)
+{
+	int nblocks = width/8;
+	allocate(ref_dct, height, width);
+	allocate(ref_mask, height/8, nblocks);
 
+	parallel(bands(height), [&](int i, int r) {
+		Runner& runner = runner_buffers[static_cast<size_t>(r)];
+		int first, last;
+		band(i, height, first, last);
+		for (int y=first; y<last; y+=8) {
+			// a_dct = dct2(a);
+			runner.dct_a.transform(original, y);
 			// mask_a = maskeff(a,a_dct);
-			float mask_a = maskeff(a,a_dct);
-			// mask_b = maskeff(b,b_dct);
-			float mask_b = maskeff(b,b_dct);
+			maskeff(runner.dct_a, ref_mask.ptr<float>(y/8), &runner.lanes1[0]);
 
-			// if mask_b > mask_a: mask_a = mask_b;
-			mask_a = mask_b > mask_a ? mask_b : mask_a;
+			for (int l=0; l<8; l++) {
+				const float *src = runner.dct_a.row(l);
+				std::copy(src, src+8*nblocks, ref_dct.ptr<float>(y+l));
+			}
+		}
+	});
+}
+
+float PSNRHVS::compare(const cv::Mat& processed)
+{
+	parallel(bands(height), [&](int i, int r) {
+		const float *dct_rows[8];
+		int first, last;
+		band(i, height, first, last);
+		for (int y=first; y<last; y+=8) {
+			for (int l=0; l<8; l++) {
+				dct_rows[l] = ref_dct.ptr<float>(y+l);
+			}
+			compareStrip(processed, y, dct_rows, ref_mask.ptr<float>(y/8), runner_buffers[static_cast<size_t>(r)]);
+		}
+	});
 
+	finish();
+
+	return psnrhvsm;
+}
+
+void PSNRHVS::compareStrip(const cv::Mat& processed, int y, const float *const dct_rows[8], const float *mask_ref, Runner& runner)
+{
+	int nblocks = runner.dct_b.blocks();
+	float *l1 = &runner.lanes1[0];
+	float *l2 = &runner.lanes2[0];
+	const float *mask_b = &runner.mask_b[0];
+
+	// Coefficient (k,l) of block b is in lane 8*b+k of row l
+	// b_dct = dct2(b);
+	runner.dct_b.transform(processed, y);
+	// mask_b = maskeff(b,b_dct);
+	maskeff(runner.dct_b, &runner.mask_b[0], l1);
+
+	for (int x=0; x<8*nblocks; x++) {
+		l1[x] = 0.0f;
+		l2[x] = 0.0f;
+	}
+
+	for (int l=0; l<8; l++) {
+		const float *ptr_a = dct_rows[l];
+		const float *ptr_b = runner.dct_b.row(l);
+		for (int b=0; b<nblocks; b++) {
+			// if mask_b > mask_a: mask_a = mask_b;
+			float mask = mask_b[b] > mask_ref[b] ? mask_b[b] : mask_ref[b];
 			for (int k=0; k<8; k++) {
-				const float *ptr_a = a_dct.ptr<float>(k);
-				const float *ptr_b = b_dct.ptr<float>(k);
-				for (int l=0; l<8; l++) {
-					// u = abs(a_dct(k,l)-b_dct(k,l));
-					float u = std::abs(*ptr_a++ - *ptr_b++);
-					// s2 = s2 + (u*CSF(k,l)).^2;
-					tmp = u*CSF[k][l];
-					s2 += tmp*tmp;
-					// if (k~=1) | (l~=1)
-					if (k != 0 || l !=0) {
-						// if u < mask_a/mask(k,l)
-						tmp = mask_a/MASK[k][l];
-						if (u < tmp) {
-							// u = 0;
-							u = 0;
-						}
-						else {
-							// u = u - mask_a/mask(k,l);
-							u -= tmp;
-						}
-					}
-					// s1 = s1 + (u*CSF(k,l)).^2;
-					tmp = u*CSF[k][l];
-					s1 += tmp*tmp;
-				}
+				int x = 8*b+k;
+				// u = abs(a_dct(k,l)-b_dct(k,l));
+				float u = std::abs(ptr_a[x] - ptr_b[x]);
+				// s2 = s2 + (u*CSF(k,l)).^2;
+				float tmp = u*csf_t[l][k];
+				l2[x] += tmp*tmp;
+				// if (k~=1) | (l~=1)
+				//   if u < mask_a/mask(k,l): u = 0;
+				//   else: u = u - mask_a/mask(k,l);
+				float th = mask/mask_t[l][k]*ac_t[l][k];
+				u = u < th ? 0.0f : u - th;
+				// s1 = s1 + (u*CSF(k,l)).^2;
+				tmp = u*csf_t[l][k];
+				l1[x] += tmp*tmp;
 			}
 		}
 	}
 
+	float *e1 = &errors1[static_cast<size_t>((y/8)*nblocks)];
+	float *e2 = &errors2[static_cast<size_t>((y/8)*nblocks)];
+	for (int b=0; b<nblocks; b++) {
+		float b1 = 0.0f;
+		float b2 = 0.0f;
+		for (int k=0; k<8; k++) {
+			b1 += l1[8*b+k];
+			b2 += l2[8*b+k];
+		}
+		e1[b] = b1;
+		e2[b] = b2;
+		if (map != NULL) {
+			map[(y/8)*nblocks+b] = b1/64.0f;
+		}
+	}
+}
+
+void PSNRHVS::finish()
+{
+	double s1 = 0.0;
+	double s2 = 0.0;
+	for (size_t b=0; b<errors1.size(); b++) {
+		s1 += static_cast<double>(errors1[b]);
+		s2 += static_cast<double>(errors2[b]);
+	}
+
+	double num = static_cast<double>(width)*height;
+
 	// s1 = s1/num;
-	s1 /= num;
+	float s1n = static_cast<float>(s1/num);
 	// s2 = s2/num;
-	s2 /= num;
+	float s2n = static_cast<float>(s2/num);
 
 	// if s1 == 0: p_hvs_m = 100000;
 	// else: p_hvs_m = 10*log10(255*255/s1);
-	psnrhvsm = s1 <= FLT_EPSILON ? 100000.0f : float(10*log10(255*255/s1));
+	psnrhvsm = s1n <= FLT_EPSILON ? MAX_INDEX : float(10*log10(255*255/s1n));
 	// if s2 == 0: p_hvs = 100000;
 	// else: p_hvs = 10*log10(255*255/s2);
-	psnrhvs = s2 <= FLT_EPSILON ? 100000.0f : float(10*log10(255*255/s2));
-
-	return psnrhvsm;
+	psnrhvs = s2n <= FLT_EPSILON ? MAX_INDEX : float(10*log10(255*255/s2n));
 }
 
-float PSNRHVS::maskeff(const cv::Mat &z, const cv::Mat &zdct)
+void PSNRHVS::maskeff(const BlockDCT& dct, float *mask, float *lanes) const
 {
-	float m = 0;
-
-	float val;
-	for (int k=0; k<8; k++) {
-		const float* ptr = zdct.ptr<float>(k);
-		for (int l=0; l<8; l++) {
-			val = *ptr++;
-			// if (k~=1) | (l~=1): m = m + (zdct(k,l).^2) * mask(k,l);
-			if (k!=0 || l!=0) m += val*val*MASK[k][l];
-		}
-	}
+	int nblocks = dct.blocks();
 
-	// pop=vari(z);
-	float pop = vari(z);
-	// if pop ~= 0: pop=(vari(z(1:4,1:4))+vari(z(1:4,5:8))+vari(z(5:8,5:8))+vari(z(5:8,1:4)))/pop;
-	if (fabsf(pop) > FLT_EPSILON) {
-		pop = (vari(z(cv::Range(0,4),cv::Range(0,4)))
-			+vari(z(cv::Range(0,4),cv::Range(4,8)))
-			+vari(z(cv::Range(4,8),cv::Range(4,8)))
-			+vari(z(cv::Range(4,8),cv::Range(0,4)))) / pop;
+	// if (k~=1) | (l~=1): m = m + (zdct(k,l).^2) * mask(k,l);
+	for (int x=0; x<8*nblocks; x++) {
+		lanes[x] = 0.0f;
+	}
+	for (int l=0; l<8; l++) {
+		const float *ptr = dct.row(l);
+		for (int b=0; b<nblocks; b++) {
+			for (int k=0; k<8; k++) {
+				int x = 8*b+k;
+				lanes[x] += ptr[x]*ptr[x]*mask_t[l][k]*ac_t[l][k];
+			}
+		}
 	}
 
-	// m = sqrt(m*pop)/32;
-	return sqrtf(m*pop)/32.0f;
-}
+	const float *var = dct.variance();
+	const float *qvar = dct.quadrantVariance();
+	for (int b=0; b<nblocks; b++) {
+		float m = 0.0f;
+		for (int k=0; k<8; k++) {
+			m += lanes[8*b+k];
+		}
 
-float PSNRHVS::vari(const cv::Mat &z)
-{
-	float mean = 0.0;
-	float d = 0.0;
-
-	int w = z.cols;
-	int h = z.rows;
-	float N = static_cast<float>(h*w);
-
-	for (int i=0; i<h; i++) {
-		const float *ptr = z.ptr<float>(i);
-		for (int j=0; j<w; j++) {
-			d += (*ptr)*(*ptr);
-			mean += *ptr++;
+		// pop=vari(z);
+		float pop = var[b];
+		// if pop ~= 0: pop=(vari(z(1:4,1:4))+vari(z(1:4,5:8))+vari(z(5:8,5:8))+vari(z(5:8,1:4)))/pop;
+		if (fabsf(pop) > FLT_EPSILON) {
+			pop = qvar[b] / pop;
 		}
-	}
-	d /= N;
-	mean /= N;
-	d -= mean*mean;
-	d *= N*N/(N-1);
 
-	// d=var(AA(:))*length(AA(:));
-	return d;
+		// m = sqrt(m*pop)/32;
+		mask[b] = sqrtf(m*pop)/32.0f;
+	}
 }
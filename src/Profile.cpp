@@ -0,0 +1,193 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <math.h>
+#include <opencv2/core/core.hpp>
+#include "Profile.hpp"
+
+static const char *STAGE_NAME[STAGE_SIZE] = {
+	"read", "copy", "convert", "hash", "psnr", "ssim", "msssim", "vifp", "psnrhvs", "wait", "frame", "write"
+};
+
+Histogram::Histogram() : nb(0), sum(0.0), maximum(0.0)
+{
+	for (int b=0; b<BUCKETS; b++) {
+		counts[b] = 0;
+	}
+}
+
+int Histogram::bucket(double ns)
+{
+	if (ns < 1.0) {
+		return 0;
+	}
+	// ns = m * 2^e with 0.5 <= m < 1, the mantissa selects the sub-bucket
+	int e;
+	double m = frexp(ns, &e);
+	int b = e*SUB_BUCKETS + static_cast<int>((m-0.5)*2*SUB_BUCKETS);
+	return b < BUCKETS ? b : BUCKETS-1;
+}
+
+double Histogram::bucketValue(int b)
+{
+	// Middle of the bucket
+	int e = b / SUB_BUCKETS;
+	double m = 0.5 + (b % SUB_BUCKETS + 0.5) / (2*SUB_BUCKETS);
+	return ldexp(m, e);
+}
+
+void Histogram::record(double seconds)
+{
+	counts[bucket(seconds*1e9)]++;
+	nb++;
+	sum += seconds;
+	if (seconds > maximum) {
+		maximum = seconds;
+	}
+}
+
+void Histogram::merge(const Histogram& other)
+{
+	for (int b=0; b<BUCKETS; b++) {
+		counts[b] += other.counts[b];
+	}
+	nb += other.nb;
+	sum += other.sum;
+	if (other.maximum > maximum) {
+		maximum = other.maximum;
+	}
+}
+
+uint64_t Histogram::count() const
+{
+	return nb;
+}
+
+double Histogram::total() const
+{
+	return sum;
+}
+
+double Histogram::max() const
+{
+	return maximum;
+}
+
+double Histogram::percentile(double p) const
+{
+	if (nb == 0) {
+		return 0.0;
+	}
+	// Rank of the sample, starting at 1
+	uint64_t rank = static_cast<uint64_t>(ceil(p/100*static_cast<double>(nb)));
+	if (rank < 1) {
+		rank = 1;
+	}
+	uint64_t seen = 0;
+	for (int b=0; b<BUCKETS; b++) {
+		seen += counts[b];
+		if (seen >= rank) {
+			// The estimate cannot exceed the largest sample
+			double value = bucketValue(b)*1e-9;
+			return value < maximum ? value : maximum;
+		}
+	}
+	return maximum;
+}
+
+Profile::Profile() : allocations(0)
+{
+	for (int c=0; c<COUNTER_SIZE; c++) {
+		counters[c] = 0;
+	}
+}
+
+void Profile::record(int stage, double seconds)
+{
+	stages[stage].record(seconds);
+}
+
+void Profile::recordAllocations(uint64_t n)
+{
+	allocations += n;
+}
+
+uint64_t Profile::getAllocations() const
+{
+	return allocations;
+}
+
+void Profile::count(int counter)
+{
+	counters[counter]++;
+}
+
+uint64_t Profile::getCount(int counter) const
+{
+	return counters[counter];
+}
+
+void Profile::merge(const Profile& other)
+{
+	for (int s=0; s<STAGE_SIZE; s++) {
+		stages[s].merge(other.stages[s]);
+	}
+	allocations += other.allocations;
+	for (int c=0; c<COUNTER_SIZE; c++) {
+		counters[c] += other.counters[c];
+	}
+}
+
+void Profile::write(FILE *file) const
+{
+	fprintf(file, "{");
+	bool first = true;
+	for (int s=0; s<STAGE_SIZE; s++) {
+		const Histogram& h = stages[s];
+		if (h.count() == 0) {
+			continue;
+		}
+		fprintf(file, "%s\n    \"%s\": {\"count\": %llu, \"total\": %.6f, \"mean\": %.9f, \"p50\": %.9f, \"p95\": %.9f, \"p99\": %.9f, \"max\": %.9f}",
+			first ? "" : ",", STAGE_NAME[s], static_cast<unsigned long long>(h.count()), h.total(),
+			h.total()/static_cast<double>(h.count()), h.percentile(50), h.percentile(95), h.percentile(99), h.max());
+		first = false;
+	}
+	fprintf(file, "\n  }");
+}
+
+double Profile::now()
+{
+	return static_cast<double>(cv::getTickCount()) / cv::getTickFrequency();
+}
+
+StageTimer::StageTimer(Profile& p) : profile(p), start(Profile::now())
+{
+}
+
+void StageTimer::lap(int stage)
+{
+	double end = Profile::now();
+	profile.record(stage, end-start);
+	start = end;
+}
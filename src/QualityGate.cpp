@@ -0,0 +1,221 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <algorithm>
+#include <limits>
+#include "QualityGate.hpp"
+#include "ResultWriter.hpp"
+
+QualityGate::QualityGate() : max_bad(0), nbplanes(1), rejected(false)
+{
+	for (int m=0; m<METRIC_SIZE; m++) {
+		floor[m] = 0.0f;
+		has_floor[m] = false;
+		window_length[m] = 0;
+		window_floor[m] = 0.0f;
+		max_index[m] = std::numeric_limits<float>::infinity();
+	}
+}
+
+void QualityGate::setFloor(int metric, float value)
+{
+	floor[metric] = value;
+	has_floor[metric] = true;
+}
+
+void QualityGate::setWindow(int metric, int length, float value)
+{
+	window_length[metric] = length;
+	window_floor[metric] = value;
+}
+
+void QualityGate::setMaxBad(int count)
+{
+	max_bad = count;
+}
+
+void QualityGate::setMaxIndex(int metric, float value)
+{
+	max_index[metric] = value;
+}
+
+bool QualityGate::hasThreshold(int metric) const
+{
+	return has_floor[metric] || window_length[metric] > 0;
+}
+
+bool QualityGate::isEnabled() const
+{
+	for (int m=0; m<METRIC_SIZE; m++) {
+		if (hasThreshold(m)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool QualityGate::hasFloor() const
+{
+	for (int m=0; m<METRIC_SIZE; m++) {
+		if (has_floor[m]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void QualityGate::start(int nbvideos, int planes)
+{
+	nbplanes = planes;
+	// Built in place, a Video cannot be moved
+	videos = std::vector<Video>(static_cast<size_t>(nbvideos));
+	for (size_t v=0; v<videos.size(); v++) {
+		for (int m=0; m<METRIC_SIZE; m++) {
+			Window& window = videos[v].window[m];
+			window.values.resize(static_cast<size_t>(window_length[m]));
+			window.frames.resize(static_cast<size_t>(window_length[m]));
+			window.count = 0;
+			window.next = 0;
+		}
+		videos[v].bad = 0;
+		videos[v].rejected = false;
+	}
+}
+
+void QualityGate::check(int frame, int v, const float result[PLANE_SIZE][METRIC_SIZE])
+{
+	Video& video = videos[static_cast<size_t>(v)];
+	// The frames still in flight when the video was rejected do not change the verdict
+	if (video.rejected) {
+		return;
+	}
+
+	bool bad = false;
+	for (int m=0; m<METRIC_SIZE; m++) {
+		if (!hasThreshold(m)) {
+			continue;
+		}
+		float value = nbplanes > 1 ? ResultWriter::combine(result, m) : result[PLANE_Y][m];
+		value = std::min(value, max_index[m]);
+
+		// A NaN index is below any floor
+		if (has_floor[m] && !(value >= floor[m])) {
+			Violation violation = {frame, frame, m, value, floor[m]};
+			video.violations.push_back(violation);
+			bad = true;
+		}
+
+		int length = window_length[m];
+		if (length > 0) {
+			Window& window = video.window[m];
+			size_t next = static_cast<size_t>(window.next);
+			if (window.count < length) {
+				window.count++;
+			}
+			window.values[next] = value;
+			window.frames[next] = frame;
+			window.next = (window.next+1) % length;
+			if (window.count < length) {
+				continue;
+			}
+
+			// Summed again at each frame: a running sum would stay infinite (then NaN) once
+			// a non-finite index has entered the window
+			double sum = 0.0;
+			for (int i=0; i<length; i++) {
+				sum += static_cast<double>(window.values[static_cast<size_t>(i)]);
+			}
+			float mean = static_cast<float>(sum / length);
+			if (!(mean >= window_floor[m])) {
+				// The oldest frame of the window is the next one to be replaced
+				Violation violation = {window.frames[static_cast<size_t>(window.next)], frame, m, mean, window_floor[m]};
+				video.violations.push_back(violation);
+				video.rejected = true;
+			}
+		}
+	}
+
+	if (bad && ++video.bad > max_bad) {
+		video.rejected = true;
+	}
+	if (video.rejected) {
+		rejected = true;
+	}
+}
+
+bool QualityGate::isRejected() const
+{
+	return rejected;
+}
+
+bool QualityGate::isRejected(int video) const
+{
+	return videos[static_cast<size_t>(video)].rejected;
+}
+
+bool QualityGate::allRejected() const
+{
+	for (size_t v=0; v<videos.size(); v++) {
+		if (!videos[v].rejected) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void QualityGate::writeSummary(FILE *file, const char *const metric_names[METRIC_SIZE],
+	const std::vector<const char*>& video_names) const
+{
+	for (size_t v=0; v<videos.size(); v++) {
+		const Video& video = videos[v];
+		fprintf(file, "%s: %s, %d bad frame(s)\n", video_names[v], video.rejected ? "rejected" : "passed", video.bad);
+		if (!video.rejected) {
+			continue;
+		}
+		for (size_t i=0; i<video.violations.size(); i++) {
+			const Violation& violation = video.violations[i];
+			if (violation.first == violation.last) {
+				fprintf(file, " frame %d: %s %.6f below %g\n", violation.first,
+					metric_names[violation.metric], static_cast<double>(violation.value), static_cast<double>(violation.floor));
+			}
+			else {
+				fprintf(file, " frames %d-%d: mean %s %.6f below %g\n", violation.first, violation.last,
+					metric_names[violation.metric], static_cast<double>(violation.value), static_cast<double>(violation.floor));
+			}
+		}
+	}
+}
+
+void QualityGate::writeReport(FILE *file) const
+{
+	fprintf(file, "\"rejected\": [");
+	for (size_t v=0; v<videos.size(); v++) {
+		fprintf(file, "%s%s", v > 0 ? ", " : "", videos[v].rejected ? "true" : "false");
+	}
+	fprintf(file, "],\n  \"bad_frames\": [");
+	for (size_t v=0; v<videos.size(); v++) {
+		fprintf(file, "%s%d", v > 0 ? ", " : "", videos[v].bad);
+	}
+	fprintf(file, "]");
+}
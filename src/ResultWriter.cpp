@@ -0,0 +1,426 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <string.h>
+#include "ResultWriter.hpp"
+
+// Weights of the components in the combined quality index
+static const float PLANE_WEIGHT[PLANE_SIZE] = {6.0f, 1.0f, 1.0f};
+
+// Names of the metrics in the output file names and columns, and of the components in the columns
+static const char *METRIC_FILE[METRIC_SIZE] = {"psnr", "ssim", "msssim", "vifp", "psnrhvs", "psnrhvsm"};
+static const char *PLANE_NAME[PLANE_SIZE] = {"y", "u", "v"};
+
+// Binary format
+static const char BINARY_MAGIC[4] = {'V', 'Q', 'M', 'T'};
+static const uint32_t BINARY_VERSION = 1;
+static const size_t BINARY_NAME = 16;	// bytes per column name
+
+// Maps format
+static const char MAPS_MAGIC[4] = {'V', 'Q', 'M', 'M'};
+static const uint32_t MAPS_VERSION = 1;
+static const char *MAP_NAME[MAP_SIZE] = {"ssim", "psnrhvsm"};
+
+// Append a 32-bit value in little-endian order
+static void put32(std::vector<unsigned char>& buffer, uint32_t value)
+{
+	for (int i=0; i<4; i++) {
+		buffer.push_back(static_cast<unsigned char>(value >> (8*i)));
+	}
+}
+
+static void putFloat(std::vector<unsigned char>& buffer, float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	put32(buffer, bits);
+}
+
+ResultWriter::ResultWriter(int fmt, const std::vector<const char*>& files, const bool metrics[METRIC_SIZE],
+	int planes, bool f) :
+	format(fmt), nbplanes(planes), flush(f), outputs(files.size()), names(files), map_size(0), closing(false)
+{
+	for (int m=0; m<METRIC_SIZE; m++) {
+		enabled[m] = metrics[m];
+	}
+
+	char *str = new char[256];
+	for (size_t v=0; v<outputs.size(); v++) {
+		Output& output = outputs[v];
+		for (int m=0; m<METRIC_SIZE; m++) {
+			output.file[m] = NULL;
+			for (int p=0; p<PLANE_SIZE; p++) {
+				output.avg[p][m] = 0.0f;
+			}
+		}
+		output.nbframes = 0;
+		output.maps = NULL;
+
+		if (format == FORMAT_SPLIT) {
+			for (int m=0; m<METRIC_SIZE; m++) {
+				if (enabled[m]) {
+					snprintf(str, 256, "%s_%s.csv", names[v], METRIC_FILE[m]);
+					output.file[m] = fopen(str, "w");
+				}
+			}
+		}
+		else if (format == FORMAT_CSV) {
+			snprintf(str, 256, "%s.csv", names[v]);
+			output.file[0] = fopen(str, "w");
+		}
+		else {
+			snprintf(str, 256, "%s.bin", names[v]);
+			output.file[0] = fopen(str, "wb");
+		}
+		writeHeader(output);
+	}
+	delete[] str;
+
+	thread = std::thread(&ResultWriter::loop, this);
+}
+
+ResultWriter::~ResultWriter()
+{
+	if (thread.joinable()) {
+		close();
+	}
+}
+
+void ResultWriter::setMaps(const MapLayout layout[MAP_SIZE])
+{
+	map_size = 0;
+	for (int m=0; m<MAP_SIZE; m++) {
+		map_size += static_cast<size_t>(layout[m].rows*layout[m].cols);
+	}
+
+	// Header
+	row.clear();
+	for (size_t i=0; i<sizeof(MAPS_MAGIC); i++) {
+		row.push_back(static_cast<unsigned char>(MAPS_MAGIC[i]));
+	}
+	put32(row, MAPS_VERSION);
+	uint32_t count = 0;
+	for (int m=0; m<MAP_SIZE; m++) {
+		count += layout[m].rows > 0 ? 1 : 0;
+	}
+	put32(row, count);
+	for (int m=0; m<MAP_SIZE; m++) {
+		if (layout[m].rows == 0) {
+			continue;
+		}
+		char name[BINARY_NAME] = {0};
+		snprintf(name, BINARY_NAME, "%s", MAP_NAME[m]);
+		for (size_t i=0; i<BINARY_NAME; i++) {
+			row.push_back(static_cast<unsigned char>(name[i]));
+		}
+		put32(row, static_cast<uint32_t>(layout[m].block));
+		put32(row, static_cast<uint32_t>(layout[m].rows));
+		put32(row, static_cast<uint32_t>(layout[m].cols));
+	}
+
+	char *str = new char[256];
+	for (size_t v=0; v<outputs.size(); v++) {
+		snprintf(str, 256, "%s_maps.bin", names[v]);
+		outputs[v].maps = fopen(str, "wb");
+		if (outputs[v].maps != NULL) {
+			fwrite(&row[0], 1, row.size(), outputs[v].maps);
+		}
+	}
+	delete[] str;
+}
+
+void ResultWriter::write(int frame, int video, const float result[PLANE_SIZE][METRIC_SIZE], const float *maps)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(Record());
+		Record& record = queue.back();
+		record.frame = frame;
+		record.video = video;
+		memcpy(record.result, result, sizeof(record.result));
+		if (maps != NULL && map_size > 0) {
+			// The buffers of the written maps are reused, they have the right size already
+			if (!spare.empty()) {
+				record.maps.swap(spare.back());
+				spare.pop_back();
+			}
+			record.maps.assign(maps, maps+map_size);
+		}
+	}
+	cond.notify_one();
+}
+
+void ResultWriter::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	cond.notify_one();
+	thread.join();
+
+	for (size_t v=0; v<outputs.size(); v++) {
+		Output& output = outputs[v];
+		if (output.nbframes > 0) {
+			for (int m=0; m<METRIC_SIZE; m++) {
+				for (int p=0; p<nbplanes; p++) {
+					output.avg[p][m] /= static_cast<float>(output.nbframes);
+				}
+			}
+			writeRow(output, -1, output.avg);
+		}
+		for (int m=0; m<METRIC_SIZE; m++) {
+			if (output.file[m] != NULL) {
+				fclose(output.file[m]);
+				output.file[m] = NULL;
+			}
+		}
+		if (output.maps != NULL) {
+			fclose(output.maps);
+			output.maps = NULL;
+		}
+	}
+}
+
+void ResultWriter::getProfile(Profile& total) const
+{
+	total.merge(profile);
+}
+
+float ResultWriter::combine(const float result[PLANE_SIZE][METRIC_SIZE], int m)
+{
+	float sum = 0.0f;
+	float weights = 0.0f;
+	for (int p=0; p<PLANE_SIZE; p++) {
+		sum += PLANE_WEIGHT[p]*result[p][m];
+		weights += PLANE_WEIGHT[p];
+	}
+	return sum / weights;
+}
+
+void ResultWriter::loop()
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!closing && queue.empty()) {
+				cond.wait(lock);
+			}
+			// Queued records are still written on close
+			if (queue.empty()) {
+				return;
+			}
+			batch.swap(queue);
+		}
+
+		StageTimer timer(profile);
+		for (size_t i=0; i<batch.size(); i++) {
+			const Record& record = batch[i];
+			Output& output = outputs[static_cast<size_t>(record.video)];
+			for (int m=0; m<METRIC_SIZE; m++) {
+				for (int p=0; p<nbplanes; p++) {
+					output.avg[p][m] += record.result[p][m];
+				}
+			}
+			output.nbframes++;
+			writeRow(output, record.frame, record.result);
+			if (!record.maps.empty()) {
+				writeMaps(output, record.frame, record.maps);
+			}
+			timer.lap(STAGE_WRITE);
+		}
+		if (map_size > 0) {
+			std::lock_guard<std::mutex> lock(mutex);
+			for (size_t i=0; i<batch.size(); i++) {
+				spare.push_back(std::vector<float>());
+				spare.back().swap(batch[i].maps);
+			}
+		}
+		batch.clear();
+
+		if (flush) {
+			for (size_t v=0; v<outputs.size(); v++) {
+				for (int m=0; m<METRIC_SIZE; m++) {
+					if (outputs[v].file[m] != NULL) {
+						fflush(outputs[v].file[m]);
+					}
+				}
+				if (outputs[v].maps != NULL) {
+					fflush(outputs[v].maps);
+				}
+			}
+		}
+	}
+}
+
+void ResultWriter::writeHeader(Output& output)
+{
+	if (format == FORMAT_SPLIT) {
+		for (int m=0; m<METRIC_SIZE; m++) {
+			if (output.file[m] != NULL) {
+				fprintf(output.file[m], nbplanes > 1 ? "frame,y,u,v,yuv\n" : "frame,value\n");
+			}
+		}
+		return;
+	}
+
+	FILE *file = output.file[0];
+	if (file == NULL) {
+		return;
+	}
+
+	// Column names
+	std::vector<const char*> metric;
+	std::vector<const char*> plane;
+	for (int m=0; m<METRIC_SIZE; m++) {
+		if (!enabled[m]) {
+			continue;
+		}
+		for (int p=0; p<nbplanes; p++) {
+			metric.push_back(METRIC_FILE[m]);
+			plane.push_back(nbplanes > 1 ? PLANE_NAME[p] : NULL);
+		}
+		if (nbplanes > 1) {
+			metric.push_back(METRIC_FILE[m]);
+			plane.push_back("yuv");
+		}
+	}
+
+	if (format == FORMAT_CSV) {
+		fprintf(file, "frame");
+		for (size_t c=0; c<metric.size(); c++) {
+			if (plane[c] != NULL) {
+				fprintf(file, ",%s_%s", metric[c], plane[c]);
+			}
+			else {
+				fprintf(file, ",%s", metric[c]);
+			}
+		}
+		fprintf(file, "\n");
+		return;
+	}
+
+	row.clear();
+	for (size_t i=0; i<sizeof(BINARY_MAGIC); i++) {
+		row.push_back(static_cast<unsigned char>(BINARY_MAGIC[i]));
+	}
+	put32(row, BINARY_VERSION);
+	put32(row, static_cast<uint32_t>(metric.size()));
+	for (size_t c=0; c<metric.size(); c++) {
+		char name[BINARY_NAME] = {0};
+		if (plane[c] != NULL) {
+			snprintf(name, BINARY_NAME, "%s_%s", metric[c], plane[c]);
+		}
+		else {
+			snprintf(name, BINARY_NAME, "%s", metric[c]);
+		}
+		for (size_t i=0; i<BINARY_NAME; i++) {
+			row.push_back(static_cast<unsigned char>(name[i]));
+		}
+	}
+	fwrite(&row[0], 1, row.size(), file);
+}
+
+void ResultWriter::writeRow(Output& output, int frame, const float result[PLANE_SIZE][METRIC_SIZE])
+{
+	if (format == FORMAT_SPLIT) {
+		for (int m=0; m<METRIC_SIZE; m++) {
+			FILE *file = output.file[m];
+			if (file == NULL) {
+				continue;
+			}
+			if (frame < 0) {
+				fprintf(file, "average");
+			}
+			else {
+				fprintf(file, "%d", frame);
+			}
+			for (int p=0; p<nbplanes; p++) {
+				fprintf(file, ",%.6f", static_cast<double>(result[p][m]));
+			}
+			if (nbplanes > 1) {
+				fprintf(file, ",%.6f", static_cast<double>(combine(result, m)));
+			}
+			fprintf(file, "\n");
+		}
+		return;
+	}
+
+	FILE *file = output.file[0];
+	if (file == NULL) {
+		return;
+	}
+
+	if (format == FORMAT_CSV) {
+		if (frame < 0) {
+			fprintf(file, "average");
+		}
+		else {
+			fprintf(file, "%d", frame);
+		}
+		for (int m=0; m<METRIC_SIZE; m++) {
+			if (!enabled[m]) {
+				continue;
+			}
+			for (int p=0; p<nbplanes; p++) {
+				fprintf(file, ",%.6f", static_cast<double>(result[p][m]));
+			}
+			if (nbplanes > 1) {
+				fprintf(file, ",%.6f", static_cast<double>(combine(result, m)));
+			}
+		}
+		fprintf(file, "\n");
+		return;
+	}
+
+	// Two's complement, the averages are stored with frame number -1
+	row.clear();
+	put32(row, static_cast<uint32_t>(frame));
+	for (int m=0; m<METRIC_SIZE; m++) {
+		if (!enabled[m]) {
+			continue;
+		}
+		for (int p=0; p<nbplanes; p++) {
+			putFloat(row, result[p][m]);
+		}
+		if (nbplanes > 1) {
+			putFloat(row, combine(result, m));
+		}
+	}
+	fwrite(&row[0], 1, row.size(), file);
+}
+
+void ResultWriter::writeMaps(Output& output, int frame, const std::vector<float>& maps)
+{
+	if (output.maps == NULL) {
+		return;
+	}
+
+	row.clear();
+	put32(row, static_cast<uint32_t>(frame));
+	for (size_t i=0; i<maps.size(); i++) {
+		putFloat(row, maps[i]);
+	}
+	fwrite(&row[0], 1, row.size(), output.maps);
+}
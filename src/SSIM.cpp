@@ -33,82 +33,227 @@
 //   Transactions on Image Processing, vol. 13, no. 4, pp. 600–612, April 2004.
 //
 
+#include <algorithm>
 #include "SSIM.hpp"
 
 const float SSIM::C1 = 6.5025f;
 const float SSIM::C2 = 58.5225f;
 
-SSIM::SSIM(int h, int w) : Metric(h, w)
+const int SSIM::MAP_BLOCK;
+
+SSIM::SSIM(int h, int w) : Metric(h, w), map(NULL), runner_buffers(1, Runner(w, mapCols()))
 {
 }
 
+SSIM::Runner::Runner(int w, int map_cols) : filter(11, 1.5)
+{
+	ssim_row.resize(static_cast<size_t>(std::max(w-10, 1)));
+	cs_row.resize(static_cast<size_t>(std::max(w-10, 1)));
+	block_sums.resize(static_cast<size_t>(map_cols), 0.0);
+}
+
 float SSIM::compute(const cv::Mat& original, const cv::Mat& processed)
 {
-	cv::Scalar res = computeSSIM(original, processed);
+	cv::Scalar res = computeSSIM(original, processed, map);
+	return float(res.val[0]);
+}
+
+void SSIM::setMap(float *pooled)
+{
+	map = pooled;
+}
+
+int SSIM::mapRows() const
+{
+	return (height-10+MAP_BLOCK-1) / MAP_BLOCK;
+}
+
+int SSIM::mapCols() const
+{
+	return (width-10+MAP_BLOCK-1) / MAP_BLOCK;
+}
+
+void SSIM::setPool(ThreadPool *p)
+{
+	Metric::setPool(p);
+	runner_buffers.resize(static_cast<size_t>(runners()), runner_buffers[0]);
+}
+
+void SSIM::setReference(const cv::Mat& original)
+{
+	prepareSSIM(original, reference);
+}
+
+float SSIM::compare(const cv::Mat& processed)
+{
+	cv::Scalar res = computeSSIM(reference, processed, map);
 	return float(res.val[0]);
 }
 
-cv::Scalar SSIM::computeSSIM(const cv::Mat& img1, const cv::Mat& img2)
+cv::Scalar SSIM::computeSSIM(const cv::Mat& img1, const cv::Mat& img2, float *pooled)
+{
+	Pair pair = {&img1, NULL, &img2, pooled, cv::Scalar(), 0, 0, 0};
+	computeSSIM(&pair, 1);
+	return pair.res;
+}
+
+cv::Scalar SSIM::computeSSIM(const Reference& ref, const cv::Mat& img2, float *pooled)
 {
+	Pair pair = {NULL, &ref, &img2, pooled, cv::Scalar(), 0, 0, 0};
+	computeSSIM(&pair, 1);
+	return pair.res;
+}
+
+void SSIM::computeSSIM(Pair pairs[], int n)
+{
+	// The bands of all the pairs are numbered one after the other
+	int nbands = 0;
+	size_t nrows = 0;
+	for (int p=0; p<n; p++) {
+		Pair& pair = pairs[p];
+		pair.rows = pair.img2->rows - 10;
+		pair.first_band = nbands;
+		pair.offset = nrows;
+		nbands += bands(pair.rows);
+		nrows += static_cast<size_t>(pair.rows);
+	}
+	row_sums.resize(2*nrows);
+
+	parallel(nbands, [&](int i, int runner) {
+		int p = n-1;
+		while (pairs[p].first_band > i) {
+			p--;
+		}
+		int first, last;
+		band(i-pairs[p].first_band, pairs[p].rows, first, last);
+		computeRows(pairs[p], first, last, runner_buffers[static_cast<size_t>(runner)]);
+	});
 
-	int ht = img1.rows;
-	int wt = img1.cols;
-	int w = wt - 10;
-	int h = ht - 10;
+	// The sums of the rows are reduced in order, whatever the bands
+	for (int p=0; p<n; p++) {
+		Pair& pair = pairs[p];
+		const double *sums = &row_sums[2*pair.offset];
+		int h = pair.rows;
+		int w = pair.img2->cols - 10;
 
-	cv::Mat mu1(h,w,CV_32F), mu2(h,w,CV_32F);
-	cv::Mat mu1_sq(h,w,CV_32F), mu2_sq(h,w,CV_32F), mu1_mu2(h,w,CV_32F);
-	cv::Mat img1_sq(ht,wt,CV_32F), img2_sq(ht,wt,CV_32F), img1_img2(ht,wt,CV_32F);
-	cv::Mat sigma1_sq(h,w,CV_32F), sigma2_sq(h,w,CV_32F), sigma12(h,w,CV_32F);
-	cv::Mat tmp1(h,w,CV_32F), tmp2(h,w,CV_32F), tmp3(h,w,CV_32F);
-	cv::Mat ssim_map(h,w,CV_32F), cs_map(h,w,CV_32F);
+		double ssim_sum = 0.0;
+		double cs_sum = 0.0;
+		for (int y=0; y<h; y++) {
+			ssim_sum += sums[2*y];
+			cs_sum += sums[2*y+1];
+		}
 
-	// mu1 = filter2(window, img1, 'valid');
-	applyGaussianBlur(img1, mu1, 11, 1.5);
+		// mssim = mean2(ssim_map);
+		double mssim = ssim_sum / (static_cast<double>(w)*h);
+		// mcs = mean2(cs_map);
+		double mcs = cs_sum / (static_cast<double>(w)*h);
 
-	// mu2 = filter2(window, img2, 'valid');
-	applyGaussianBlur(img2, mu2, 11, 1.5);
+		pair.res = cv::Scalar(mssim, mcs);
+	}
+}
+
+void SSIM::computeRows(const Pair& pair, int first, int last, Runner& runner)
+{
+	// Single pass over the band: the local moments are computed one row at
+	// a time and reduced immediately, without full-frame temporaries
+	// Only the moments that depend on img2 are filtered if those of img1 are known
+	MomentFilter& filter = runner.filter;
+	if (pair.ref != NULL) {
+		filter.beginProcessed(pair.ref->img, *pair.img2, first);
+	}
+	else {
+		filter.begin(*pair.img1, *pair.img2, first);
+	}
+	int w = filter.cols();
+	double *sums = &row_sums[2*pair.offset];
+
+	for (int y=first; y<last; y++) {
+		filter.next();
+		const float *mu1 = pair.ref != NULL ? pair.ref->mu.ptr<float>(y) : filter.row(MOMENT_MU1);
+		const float *img1_sq = pair.ref != NULL ? pair.ref->sq.ptr<float>(y) : filter.row(MOMENT_SQ1);
+		sumRow(mu1, img1_sq, filter.row(MOMENT_MU2), filter.row(MOMENT_SQ2), filter.row(MOMENT_12),
+			w, runner, sums[2*y], sums[2*y+1]);
+		if (pair.pooled != NULL) {
+			poolRow(y, pair.rows, w, runner, pair.pooled);
+		}
+	}
+}
 
-	// mu1_sq = mu1.*mu1;
-	cv::multiply(mu1, mu1, mu1_sq);
-	// mu2_sq = mu2.*mu2;
-	cv::multiply(mu2, mu2, mu2_sq);
-	// mu1_mu2 = mu1.*mu2;
-	cv::multiply(mu1, mu2, mu1_mu2);
+void SSIM::prepareSSIM(const cv::Mat& img1, Reference& ref)
+{
+	int h = img1.rows - 10;
+	int w = img1.cols - 10;
 
-	cv::multiply(img1, img1, img1_sq);
-	cv::multiply(img2, img2, img2_sq);
-	cv::multiply(img1, img2, img1_img2);
+	ref.img = img1;
+	allocate(ref.mu, h, w);
+	allocate(ref.sq, h, w);
+	parallel(bands(h), [&](int i, int runner) {
+		int first, last;
+		band(i, h, first, last);
+		MomentFilter& filter = runner_buffers[static_cast<size_t>(runner)].filter;
+		filter.beginReference(img1, first);
+		for (int y=first; y<last; y++) {
+			filter.next();
+			// mu1 = filter2(window, img1, 'valid');
+			const float *mu1 = filter.row(MOMENT_MU1);
+			const float *img1_sq = filter.row(MOMENT_SQ1);
+			std::copy(mu1, mu1+w, ref.mu.ptr<float>(y));
+			std::copy(img1_sq, img1_sq+w, ref.sq.ptr<float>(y));
+		}
+	});
+}
 
-	// sigma1_sq = filter2(window, img1.*img1, 'valid') - mu1_sq;
-	applyGaussianBlur(img1_sq, sigma1_sq, 11, 1.5);
-	sigma1_sq -= mu1_sq;
+void SSIM::sumRow(const float *mu1, const float *img1_sq, const float *mu2, const float *img2_sq,
+	const float *img1_img2, int w, Runner& runner, double& ssim_sum, double& cs_sum)
+{
+	float *ssim_map = &runner.ssim_row[0];
+	float *cs_map = &runner.cs_row[0];
 
-	// sigma2_sq = filter2(window, img2.*img2, 'valid') - mu2_sq;
-	applyGaussianBlur(img2_sq, sigma2_sq, 11, 1.5);
-	sigma2_sq -= mu2_sq;
+	for (int x=0; x<w; x++) {
+		// mu1_sq = mu1.*mu1;
+		float mu1_sq = mu1[x]*mu1[x];
+		// mu2_sq = mu2.*mu2;
+		float mu2_sq = mu2[x]*mu2[x];
+		// mu1_mu2 = mu1.*mu2;
+		float mu1_mu2 = mu1[x]*mu2[x];
+		// sigma1_sq = filter2(window, img1.*img1, 'valid') - mu1_sq;
+		float sigma1_sq = img1_sq[x] - mu1_sq;
+		// sigma2_sq = filter2(window, img2.*img2, 'valid') - mu2_sq;
+		float sigma2_sq = img2_sq[x] - mu2_sq;
+		// sigma12 = filter2(window, img1.*img2, 'valid') - mu1_mu2;
+		float sigma12 = img1_img2[x] - mu1_mu2;
 
-	// sigma12 = filter2(window, img1.*img2, 'valid') - mu1_mu2;
-	applyGaussianBlur(img1_img2, sigma12, 11, 1.5);
-	sigma12 -= mu1_mu2;
+		// cs_map = (2*sigma12 + C2)./(sigma1_sq + sigma2_sq + C2);
+		float tmp1 = 2*sigma12 + C2;
+		float tmp2 = sigma1_sq + sigma2_sq + C2;
+		cs_map[x] = tmp1 / tmp2;
+		// ssim_map = ((2*mu1_mu2 + C1).*(2*sigma12 + C2))./((mu1_sq + mu2_sq + C1).*(sigma1_sq + sigma2_sq + C2));
+		ssim_map[x] = (tmp1 * (2*mu1_mu2 + C1)) / (tmp2 * (mu1_sq + mu2_sq + C1));
+	}
 
-	// cs_map = (2*sigma12 + C2)./(sigma1_sq + sigma2_sq + C2);
-	tmp1 = 2*sigma12 + C2;
-	tmp2 = sigma1_sq + sigma2_sq + C2;
-	cv::divide(tmp1, tmp2, cs_map);
-	// ssim_map = ((2*mu1_mu2 + C1).*(2*sigma12 + C2))./((mu1_sq + mu2_sq + C1).*(sigma1_sq + sigma2_sq + C2));
-	tmp3 = 2*mu1_mu2 + C1;
-	cv::multiply(tmp1, tmp3, tmp1);
-	tmp3 = mu1_sq + mu2_sq + C1;
-	cv::multiply(tmp2, tmp3, tmp2);
-	cv::divide(tmp1, tmp2, ssim_map);
+	ssim_sum = sum(ssim_map, w);
+	cs_sum = sum(cs_map, w);
+}
 
-	// mssim = mean2(ssim_map);
-	double mssim = cv::mean(ssim_map).val[0];
-	// mcs = mean2(cs_map);
-	double mcs = cv::mean(cs_map).val[0];
+void SSIM::poolRow(int y, int h, int w, Runner& runner, float *pooled)
+{
+	const float *ssim_map = &runner.ssim_row[0];
+	std::vector<double>& block_sums = runner.block_sums;
+	int cols = static_cast<int>(block_sums.size());
 
-	cv::Scalar res(mssim, mcs);
+	for (int b=0; b<cols; b++) {
+		int x = b*MAP_BLOCK;
+		block_sums[static_cast<size_t>(b)] += sum(ssim_map+x, std::min(MAP_BLOCK, w-x));
+	}
 
-	return res;
+	// Last row of a block
+	if (y % MAP_BLOCK == MAP_BLOCK-1 || y == h-1) {
+		int rows = y % MAP_BLOCK + 1;
+		float *dst = pooled + (y/MAP_BLOCK)*cols;
+		for (int b=0; b<cols; b++) {
+			int n = rows*std::min(MAP_BLOCK, w-b*MAP_BLOCK);
+			dst[b] = static_cast<float>(block_sums[static_cast<size_t>(b)] / n);
+			block_sums[static_cast<size_t>(b)] = 0.0;
+		}
+	}
 }
@@ -0,0 +1,239 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <string.h>
+#include "Simd.hpp"
+
+static const char *ISA_NAME[ISA_SIZE] = {"generic", "sse2", "avx2", "avx512"};
+
+static void convolveRow(const float *src, float *dst, const float *kernel, int ksize, int n)
+{
+	const float k0 = kernel[0];
+	for (int x=0; x<n; x++) {
+		dst[x] = k0*src[x];
+	}
+	for (int t=1; t<ksize; t++) {
+		const float kt = kernel[t];
+		const float *s = src+t;
+		for (int x=0; x<n; x++) {
+			dst[x] += kt*s[x];
+		}
+	}
+}
+
+static void convolveColumn(const float *const *rows, float *dst, const float *kernel, int ksize, int n)
+{
+	const float k0 = kernel[0];
+	const float *r = rows[0];
+	for (int x=0; x<n; x++) {
+		dst[x] = k0*r[x];
+	}
+	for (int t=1; t<ksize; t++) {
+		const float kt = kernel[t];
+		r = rows[t];
+		for (int x=0; x<n; x++) {
+			dst[x] += kt*r[x];
+		}
+	}
+}
+
+static void convert8(const uint8_t *src, float *dst, float scale, int n)
+{
+	for (int x=0; x<n; x++) {
+		dst[x] = static_cast<float>(src[x])*scale;
+	}
+}
+
+static void convert16(const uint16_t *src, float *dst, float scale, int n)
+{
+	for (int x=0; x<n; x++) {
+		dst[x] = static_cast<float>(src[x])*scale;
+	}
+}
+
+static uint64_t squaredError8(const uint8_t *a, const uint8_t *b, int n)
+{
+	uint64_t sse = 0;
+	for (int x=0; x<n; x++) {
+		int d = a[x] - b[x];
+		sse += static_cast<uint64_t>(d*d);
+	}
+	return sse;
+}
+
+static uint64_t squaredError16(const uint16_t *a, const uint16_t *b, int n, int)
+{
+	uint64_t sse = 0;
+	for (int x=0; x<n; x++) {
+		int64_t d = a[x] - b[x];
+		sse += static_cast<uint64_t>(d*d);
+	}
+	return sse;
+}
+
+static void dctColumns(const float *const src[8], float *dst, int stride, const float basis[8][8], int n)
+{
+	for (int k=0; k<8; k++) {
+		float *d = dst + k*stride;
+		const float c0 = basis[k][0];
+		for (int x=0; x<n; x++) {
+			d[x] = c0*src[0][x];
+		}
+		for (int i=1; i<8; i++) {
+			const float ci = basis[k][i];
+			const float *s = src[i];
+			for (int x=0; x<n; x++) {
+				d[x] += ci*s[x];
+			}
+		}
+	}
+}
+
+static void hashBlocks(const uint8_t *data, int n, uint64_t state[HASH_LANES])
+{
+	for (int b=0; b<n; b++) {
+		const uint8_t *block = data + 8*HASH_LANES*b;
+		for (int l=0; l<HASH_LANES; l++) {
+			const uint8_t *p = block + 8*l;
+			uint64_t w = 0;
+			for (int i=7; i>=0; i--) {
+				w = w << 8 | p[i];
+			}
+			uint64_t h = state[l] + w*HASH_PRIME2;
+			state[l] = ((h << 31) | (h >> 33))*HASH_PRIME1;
+		}
+	}
+}
+
+// Kernels of the given instruction set, falling back on the ones of the
+// previous instruction sets for the kernels it does not implement
+static bool build(int isa, SimdKernels& table)
+{
+	table.convolveRow = convolveRow;
+	table.convolveColumn = convolveColumn;
+	table.convert8 = convert8;
+	table.convert16 = convert16;
+	table.squaredError8 = squaredError8;
+	table.squaredError16 = squaredError16;
+	table.dctColumns = dctColumns;
+	table.hashBlocks = hashBlocks;
+
+	bool built = true;
+	if (isa >= ISA_SSE2) {
+		built = initSSE2(table);
+	}
+	if (isa >= ISA_AVX2) {
+		built = initAVX2(table);
+	}
+	if (isa >= ISA_AVX512) {
+		built = initAVX512(table);
+	}
+	return built;
+}
+
+// Selected kernels, the best ones until select() is called
+static SimdKernels& table()
+{
+	static SimdKernels selected_table;
+	static bool initialized = build(Simd::best(), selected_table);
+	(void)initialized;
+	return selected_table;
+}
+
+static int selected_isa = -1;
+
+const SimdKernels& Simd::kernels()
+{
+	return table();
+}
+
+bool Simd::select(int isa)
+{
+	if (!isSupported(isa)) {
+		return false;
+	}
+	build(isa, table());
+	selected_isa = isa;
+	return true;
+}
+
+int Simd::selected()
+{
+	return selected_isa < 0 ? best() : selected_isa;
+}
+
+int Simd::best()
+{
+	int isa = ISA_AVX512;
+	while (isa > ISA_GENERIC && !isSupported(isa)) {
+		isa--;
+	}
+	return isa;
+}
+
+bool Simd::isSupported(int isa)
+{
+	if (isa < ISA_GENERIC || isa >= ISA_SIZE || !isSupportedByProcessor(isa)) {
+		return false;
+	}
+	// The init functions are built with the flags of their instruction set,
+	// they can only be called once the processor is known to support it
+	SimdKernels unused;
+	return build(isa, unused);
+}
+
+bool Simd::isSupportedByProcessor(int isa)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	// Also checks that the operating system saves the registers
+	__builtin_cpu_init();
+	switch (isa) {
+	case ISA_SSE2:
+		return __builtin_cpu_supports("sse2");
+	case ISA_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case ISA_AVX512:
+		return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+	default:
+		return true;
+	}
+#else
+	return isa == ISA_GENERIC;
+#endif
+}
+
+const char* Simd::name()
+{
+	return ISA_NAME[selected()];
+}
+
+int Simd::find(const char *str)
+{
+	for (int isa=0; isa<ISA_SIZE; isa++) {
+		if (strcmp(str, ISA_NAME[isa]) == 0) {
+			return isa;
+		}
+	}
+	return -1;
+}
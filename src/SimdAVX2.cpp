@@ -0,0 +1,255 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+// Built with -mavx2 (see CMakeLists.txt), only called on processors supporting it
+// Only intrinsics and the declarations of Simd.hpp are included: the inline
+// functions of other headers could be instantiated here for this instruction set
+
+#include "Simd.hpp"
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+static void convolveRow(const float *src, float *dst, const float *kernel, int ksize, int n)
+{
+	int x = 0;
+	for (; x+8<=n; x+=8) {
+		__m256 acc = _mm256_mul_ps(_mm256_set1_ps(kernel[0]), _mm256_loadu_ps(src+x));
+		for (int t=1; t<ksize; t++) {
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(kernel[t]), _mm256_loadu_ps(src+x+t)));
+		}
+		_mm256_storeu_ps(dst+x, acc);
+	}
+	for (; x<n; x++) {
+		float acc = kernel[0]*src[x];
+		for (int t=1; t<ksize; t++) {
+			acc += kernel[t]*src[x+t];
+		}
+		dst[x] = acc;
+	}
+}
+
+static void convolveColumn(const float *const *rows, float *dst, const float *kernel, int ksize, int n)
+{
+	int x = 0;
+	for (; x+8<=n; x+=8) {
+		__m256 acc = _mm256_mul_ps(_mm256_set1_ps(kernel[0]), _mm256_loadu_ps(rows[0]+x));
+		for (int t=1; t<ksize; t++) {
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(kernel[t]), _mm256_loadu_ps(rows[t]+x)));
+		}
+		_mm256_storeu_ps(dst+x, acc);
+	}
+	for (; x<n; x++) {
+		float acc = kernel[0]*rows[0][x];
+		for (int t=1; t<ksize; t++) {
+			acc += kernel[t]*rows[t][x];
+		}
+		dst[x] = acc;
+	}
+}
+
+static void convert8(const uint8_t *src, float *dst, float scale, int n)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	int x = 0;
+	for (; x+8<=n; x+=8) {
+		__m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src+x)));
+		_mm256_storeu_ps(dst+x, _mm256_mul_ps(_mm256_cvtepi32_ps(v), s));
+	}
+	for (; x<n; x++) {
+		dst[x] = static_cast<float>(src[x])*scale;
+	}
+}
+
+static void convert16(const uint16_t *src, float *dst, float scale, int n)
+{
+	const __m256 s = _mm256_set1_ps(scale);
+	int x = 0;
+	for (; x+8<=n; x+=8) {
+		__m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src+x)));
+		_mm256_storeu_ps(dst+x, _mm256_mul_ps(_mm256_cvtepi32_ps(v), s));
+	}
+	for (; x<n; x++) {
+		dst[x] = static_cast<float>(src[x])*scale;
+	}
+}
+
+// Sum of the non-negative 32-bit lanes
+static uint64_t sumLanes(__m256i acc)
+{
+	uint32_t lanes[8];
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+	uint64_t sum = 0;
+	for (int l=0; l<8; l++) {
+		sum += lanes[l];
+	}
+	return sum;
+}
+
+static uint64_t squaredError8(const uint8_t *a, const uint8_t *b, int n)
+{
+	uint64_t sse = 0;
+	int x = 0;
+	// Differences are widened to 16 bits and squared and summed pairwise with vpmaddwd
+	// A 32-bit lane grows by at most 4*255^2 per iteration, flush to 64 bits before overflowing
+	const int FLUSH = 8192;
+	while (x+32 <= n) {
+		__m256i acc = _mm256_setzero_si256();
+		for (int i=0; i<FLUSH && x+32<=n; i++, x+=32) {
+			__m256i lo = _mm256_sub_epi16(
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a+x))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b+x))));
+			__m256i hi = _mm256_sub_epi16(
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a+x+16))),
+				_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b+x+16))));
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(lo, lo));
+			acc = _mm256_add_epi32(acc, _mm256_madd_epi16(hi, hi));
+		}
+		sse += sumLanes(acc);
+	}
+	for (; x<n; x++) {
+		int d = a[x] - b[x];
+		sse += static_cast<uint64_t>(d*d);
+	}
+	return sse;
+}
+
+static uint64_t squaredError16(const uint16_t *a, const uint16_t *b, int n, int bitdepth)
+{
+	uint64_t sse = 0;
+	int x = 0;
+	if (bitdepth <= 12) {
+		// Differences of 12-bit samples fit in 16 bits, they are squared and summed pairwise with vpmaddwd
+		// A 32-bit lane grows by at most 2*4095^2 per iteration, flush to 64 bits before overflowing
+		const int FLUSH = 64;
+		const __m256i over = _mm256_set1_epi16(static_cast<short>(0xF000));
+		while (x+16 <= n) {
+			int first = x;
+			__m256i acc = _mm256_setzero_si256();
+			__m256i bits = _mm256_setzero_si256();
+			for (int i=0; i<FLUSH && x+16<=n; i++, x+=16) {
+				__m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+x));
+				__m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+x));
+				__m256i d = _mm256_sub_epi16(va, vb);
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+				bits = _mm256_or_si256(bits, _mm256_or_si256(va, vb));
+			}
+			// Samples above 12 bits: the block is summed again exactly (see SimdSSE2.cpp)
+			if (!_mm256_testz_si256(bits, over)) {
+				for (int i=first; i<x; i++) {
+					int64_t d = a[i] - b[i];
+					sse += static_cast<uint64_t>(d*d);
+				}
+			}
+			else {
+				sse += sumLanes(acc);
+			}
+		}
+	}
+	for (; x<n; x++) {
+		int64_t d = a[x] - b[x];
+		sse += static_cast<uint64_t>(d*d);
+	}
+	return sse;
+}
+
+static void dctColumns(const float *const src[8], float *dst, int stride, const float basis[8][8], int n)
+{
+	int x = 0;
+	for (; x+8<=n; x+=8) {
+		// The 8 input vectors are loaded once for the 8 outputs
+		__m256 s[8];
+		for (int i=0; i<8; i++) {
+			s[i] = _mm256_loadu_ps(src[i]+x);
+		}
+		for (int k=0; k<8; k++) {
+			__m256 acc = _mm256_mul_ps(_mm256_set1_ps(basis[k][0]), s[0]);
+			for (int i=1; i<8; i++) {
+				acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(basis[k][i]), s[i]));
+			}
+			_mm256_storeu_ps(dst+k*stride+x, acc);
+		}
+	}
+	for (; x<n; x++) {
+		for (int k=0; k<8; k++) {
+			float acc = basis[k][0]*src[0][x];
+			for (int i=1; i<8; i++) {
+				acc += basis[k][i]*src[i][x];
+			}
+			dst[k*stride+x] = acc;
+		}
+	}
+}
+
+// Low 64 bits of the products of the 64-bit lanes by a constant (see SimdSSE2.cpp)
+static __m256i mullo64(__m256i a, __m256i lo, __m256i hi)
+{
+	__m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), lo), _mm256_mul_epu32(a, hi));
+	return _mm256_add_epi64(_mm256_mul_epu32(a, lo), _mm256_slli_epi64(cross, 32));
+}
+
+static void hashBlocks(const uint8_t *data, int n, uint64_t state[HASH_LANES])
+{
+	const __m256i prime1_lo = _mm256_set1_epi64x(static_cast<long long>(HASH_PRIME1 & 0xFFFFFFFFu));
+	const __m256i prime1_hi = _mm256_set1_epi64x(static_cast<long long>(HASH_PRIME1 >> 32));
+	const __m256i prime2_lo = _mm256_set1_epi64x(static_cast<long long>(HASH_PRIME2 & 0xFFFFFFFFu));
+	const __m256i prime2_hi = _mm256_set1_epi64x(static_cast<long long>(HASH_PRIME2 >> 32));
+	__m256i v[2];
+	for (int j=0; j<2; j++) {
+		v[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state+4*j));
+	}
+	for (int b=0; b<n; b++) {
+		const uint8_t *block = data + 8*HASH_LANES*b;
+		for (int j=0; j<2; j++) {
+			__m256i w = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block+32*j));
+			__m256i h = _mm256_add_epi64(v[j], mullo64(w, prime2_lo, prime2_hi));
+			h = _mm256_or_si256(_mm256_slli_epi64(h, 31), _mm256_srli_epi64(h, 33));
+			v[j] = mullo64(h, prime1_lo, prime1_hi);
+		}
+	}
+	for (int j=0; j<2; j++) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(state+4*j), v[j]);
+	}
+}
+
+bool initAVX2(SimdKernels& table)
+{
+	table.convolveRow = convolveRow;
+	table.convolveColumn = convolveColumn;
+	table.convert8 = convert8;
+	table.convert16 = convert16;
+	table.squaredError8 = squaredError8;
+	table.squaredError16 = squaredError16;
+	table.dctColumns = dctColumns;
+	table.hashBlocks = hashBlocks;
+	return true;
+}
+
+#else
+
+bool initAVX2(SimdKernels&)
+{
+	return false;
+}
+
+#endif
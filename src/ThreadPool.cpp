@@ -0,0 +1,141 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "ThreadPool.hpp"
+
+// State of a parallel loop, shared with the workers, which can start after the loop is over
+struct ParallelLoop {
+	const ThreadPool::Body *body;	// only valid until the last iteration is done
+	int n;
+	std::atomic<int> next;		// next iteration to run
+	int done;			// number of iterations done, guarded by 'mutex'
+	std::mutex mutex;
+	std::condition_variable cond;
+};
+
+// Run the iterations left in the loop
+static void runIterations(ParallelLoop& loop, int runner)
+{
+	int count = 0;
+	for (;;) {
+		int i = loop.next.fetch_add(1);
+		if (i >= loop.n) {
+			break;
+		}
+		(*loop.body)(i, runner);
+		count++;
+	}
+	if (count > 0) {
+		std::lock_guard<std::mutex> lock(loop.mutex);
+		loop.done += count;
+		if (loop.done == loop.n) {
+			loop.cond.notify_all();
+		}
+	}
+}
+
+ThreadPool::ThreadPool(int nbthreads) : stop(false)
+{
+	for (int i=0; i<nbthreads; i++) {
+		threads.push_back(std::thread(&ThreadPool::loop, this, i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	cond.notify_all();
+	for (size_t i=0; i<threads.size(); i++) {
+		threads[i].join();
+	}
+}
+
+int ThreadPool::size() const
+{
+	return static_cast<int>(threads.size());
+}
+
+void ThreadPool::run(const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+	}
+	cond.notify_one();
+}
+
+void ThreadPool::parallelFor(int n, const Body& body)
+{
+	std::shared_ptr<ParallelLoop> loop = std::make_shared<ParallelLoop>();
+	loop->body = &body;
+	loop->n = n;
+	loop->next = 0;
+	loop->done = 0;
+
+	// Idle workers join the loop, the others find it over when they get to it
+	int helpers = std::min(n-1, size());
+	for (int runner=1; runner<=helpers; runner++) {
+		run([loop, runner](int) {
+			runIterations(*loop, runner);
+		});
+	}
+	runIterations(*loop, 0);
+
+	std::unique_lock<std::mutex> lock(loop->mutex);
+	while (loop->done < n) {
+		loop->cond.wait(lock);
+	}
+}
+
+int ThreadPool::hardwareThreads()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? static_cast<int>(n) : 1;
+}
+
+void ThreadPool::loop(int id)
+{
+	for (;;) {
+		Task task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stop && tasks.empty()) {
+				cond.wait(lock);
+			}
+			// Remaining tasks are still executed on shutdown
+			if (tasks.empty()) {
+				return;
+			}
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		task(id);
+	}
+}
@@ -45,153 +45,279 @@
 //   Image Processing, vol. 15, no. 2, pp. 430-444, February 2006.
 //
 
+#include <algorithm>
 #include "VIFP.hpp"
 
 const float VIFP::SIGMA_NSQ = 2.0f;
 
-VIFP::VIFP(int h, int w) : Metric(h, w)
+VIFP::VIFP(int h, int w) : Metric(h, w), runner_buffers(1, Runner(w))
 {
+	// Rows of the local moments of each subband
+	size_t n = 0;
+	int sub_rows = h;
+	for (int scale=0; scale<NLEVS; scale++) {
+		int N = (2 << (NLEVS-scale-1)) + 1;
+		if (scale > 0) {
+			sub_rows = (sub_rows-(N-1))/2;
+		}
+		rows[scale] = std::max(sub_rows-(N-1), 0);
+		offsets[scale] = n;
+		n += static_cast<size_t>(rows[scale]);
+	}
+	num_rows.resize(n);
+	den_rows.resize(n);
+}
+
+VIFP::Runner::Runner(int w)
+{
+	// for scale=1:4
+	for (int scale=0; scale<NLEVS; scale++) {
+		// N=2^(4-scale+1)+1;
+		int N = (2 << (NLEVS-scale-1)) + 1;
+		// win=fspecial('gaussian',N,N/5);
+		filters.push_back(MomentFilter(N, N/5.0));
+	}
+
+	// The widest statistics are the ones of the first scale
+	int N = (2 << (NLEVS-1)) + 1;
+	size_t n = static_cast<size_t>(std::max(w-(N-1), 1));
+	sigma1_sq_row.resize(n);
+	log_row.resize(n);
+}
+
+void VIFP::setPool(ThreadPool *p)
+{
+	Metric::setPool(p);
+	runner_buffers.resize(static_cast<size_t>(runners()), runner_buffers[0]);
 }
 
 float VIFP::compute(const cv::Mat& original, const cv::Mat& processed)
 {
-	double num = 0.0;
-	double den = 0.0;
-	
-	cv::Mat ref[NLEVS];
-	cv::Mat dist[NLEVS];
-	cv::Mat tmp1, tmp2;
-	
-	int w = width;
-	int h = height;
-	
+	const cv::Mat *ref[NLEVS];
+	const cv::Mat *dist[NLEVS];
+	ref[0] = &original;
+	dist[0] = &processed;
+
+	// The subbands are computed first, so that their local moments are computed at once
+	for (int scale=1; scale<NLEVS; scale++) {
+		int N = (2 << (NLEVS-scale-1)) + 1;
+		// ref=filter2(win,ref,'valid');
+		// ref=ref(1:2:end,1:2:end);
+		downsample(scale, N, *ref[scale-1], ref_levels[scale]);
+		ref[scale] = &ref_levels[scale];
+		// dist=filter2(win,dist,'valid');
+		// dist=dist(1:2:end,1:2:end);
+		downsample(scale, N, *dist[scale-1], dist_levels[scale]);
+		dist[scale] = &dist_levels[scale];
+	}
+
+	parallelScales([&](int scale, int first, int last, Runner& runner) {
+		// Single pass over the band: the five local moments are computed
+		// one row at a time and reduced immediately
+		MomentFilter& filter = runner.filters[static_cast<size_t>(scale)];
+		filter.begin(*ref[scale], *dist[scale], first);
+		int w = filter.cols();
+		float *sigma1_sq = &runner.sigma1_sq_row[0];
+		float *arg = &runner.log_row[0];
+		double *num_terms = &num_rows[offsets[scale]];
+		double *den_terms = &den_rows[offsets[scale]];
+
+		for (int y=first; y<last; y++) {
+			filter.next();
+			den_terms[y] = prepareRow(filter.row(MOMENT_MU1), filter.row(MOMENT_SQ1), sigma1_sq, arg, w);
+			num_terms[y] = compareRow(filter.row(MOMENT_MU1), sigma1_sq, filter.row(MOMENT_MU2),
+				filter.row(MOMENT_SQ2), filter.row(MOMENT_12), arg, w);
+		}
+	});
+
+	den = sumRows(den_rows);
+	double num = sumRows(num_rows);
+
+	// The log10 factors of num and den cancel out
+	return float(num/den);
+}
+
+void VIFP::setReference(const cv::Mat& original)
+{
 	// for scale=1:4
 	for (int scale=0; scale<NLEVS; scale++) {
 		// N=2^(4-scale+1)+1;
 		int N = (2 << (NLEVS-scale-1)) + 1;
-		
+		Scale& s = scales[scale];
+
 		if (scale == 0) {
-			original.copyTo(ref[scale]);
-			processed.copyTo(dist[scale]);
+			s.ref = original;
 		}
 		else {
 			// ref=filter2(win,ref,'valid');
-			applyGaussianBlur(ref[scale-1], tmp1, N, N/5.0);
-			// dist=filter2(win,dist,'valid');
-			applyGaussianBlur(dist[scale-1], tmp2, N, N/5.0);
-			
-			w = (w-(N-1)) / 2;
-			h = (h-(N-1)) / 2;
-			
-			ref[scale] = cv::Mat(h,w,CV_32F);
-			dist[scale] = cv::Mat(h,w,CV_32F);
-			
 			// ref=ref(1:2:end,1:2:end);
-			cv::resize(tmp1, ref[scale], cv::Size(w,h), 0, 0, cv::INTER_NEAREST);
-			// dist=dist(1:2:end,1:2:end);
-			cv::resize(tmp2, dist[scale], cv::Size(w,h), 0, 0, cv::INTER_NEAREST);
+			downsample(scale, N, scales[scale-1].ref, s.ref);
 		}
-		
-		computeVIFP(ref[scale], dist[scale], N, num, den);
+
+		allocate(s.mu1, rows[scale], s.ref.cols-(N-1));
+		allocate(s.sigma1_sq, rows[scale], s.ref.cols-(N-1));
 	}
-	
-	return float(num/den);
+
+	parallelScales([&](int scale, int first, int last, Runner& runner) {
+		MomentFilter& filter = runner.filters[static_cast<size_t>(scale)];
+		Scale& s = scales[scale];
+		filter.beginReference(s.ref, first);
+		int w = filter.cols();
+		float *arg = &runner.log_row[0];
+		double *den_terms = &den_rows[offsets[scale]];
+
+		for (int y=first; y<last; y++) {
+			filter.next();
+			const float *mu1 = filter.row(MOMENT_MU1);
+			std::copy(mu1, mu1+w, s.mu1.ptr<float>(y));
+			den_terms[y] = prepareRow(mu1, filter.row(MOMENT_SQ1), s.sigma1_sq.ptr<float>(y), arg, w);
+		}
+	});
+
+	den = sumRows(den_rows);
 }
 
-void VIFP::computeVIFP(const cv::Mat& ref, const cv::Mat& dist, int N, double& num, double& den)
+float VIFP::compare(const cv::Mat& processed)
 {
-	int w = ref.cols - (N-1);
-	int h = ref.rows - (N-1);
-	
-	cv::Mat tmp(h,w,CV_32F);
-	cv::Mat mu1(h,w,CV_32F), mu2(h,w,CV_32F), mu1_sq(h,w,CV_32F), mu2_sq(h,w,CV_32F), mu1_mu2(h,w,CV_32F), sigma1_sq(h,w,CV_32F), sigma2_sq(h,w,CV_32F), sigma12(h,w,CV_32F), g(h,w,CV_32F), sv_sq(h,w,CV_32F);
-	cv::Mat sigma1_sq_th, sigma2_sq_th, g_th;
-	
-	// mu1 = filter2(win, ref, 'valid');
-	applyGaussianBlur(ref, mu1, N, N/5.0);
-	// mu2 = filter2(win, dist, 'valid');
-	applyGaussianBlur(dist, mu2, N, N/5.0);
-	
-	const float EPSILON = 1e-10f;
+	const cv::Mat *dist[NLEVS];
+	dist[0] = &processed;
 
-	// mu1_sq = mu1.*mu1;
-	cv::multiply(mu1, mu1, mu1_sq);
-	// mu2_sq = mu2.*mu2;
-	cv::multiply(mu2, mu2, mu2_sq);
-	// mu1_mu2 = mu1.*mu2;
-	cv::multiply(mu1, mu2, mu1_mu2);		
-	
-	// sigma1_sq = filter2(win, ref.*ref, 'valid') - mu1_sq;
-	cv::multiply(ref, ref, tmp);
-	applyGaussianBlur(tmp, sigma1_sq, N, N/5.0);
-	sigma1_sq -= mu1_sq;
-	// sigma2_sq = filter2(win, dist.*dist, 'valid') - mu2_sq;
-	cv::multiply(dist, dist, tmp);
-	applyGaussianBlur(tmp, sigma2_sq, N, N/5.0);
-	sigma2_sq -= mu2_sq;
-	// sigma12 = filter2(win, ref.*dist, 'valid') - mu1_mu2;
-	cv::multiply(ref, dist, tmp);
-	applyGaussianBlur(tmp, sigma12, N, N/5.0);
-	sigma12 -= mu1_mu2;
-	
-	// sigma1_sq(sigma1_sq<0)=0;
-	cv::max(sigma1_sq, 0.0f, sigma1_sq);
-	// sigma2_sq(sigma2_sq<0)=0;
-	cv::max(sigma2_sq, 0.0f, sigma2_sq);
-	
-	// g=sigma12./(sigma1_sq+1e-10);
-	tmp = sigma1_sq + EPSILON;
-	cv::divide(sigma12, tmp, g);
-	
-	// sv_sq=sigma2_sq-g.*sigma12;
-	cv::multiply(g, sigma12, tmp);
-	sv_sq = sigma2_sq - tmp;
-	
-	cv::threshold(sigma1_sq, sigma1_sq_th, EPSILON, 1.0f, cv::THRESH_BINARY);
+	for (int scale=1; scale<NLEVS; scale++) {
+		int N = (2 << (NLEVS-scale-1)) + 1;
+		// dist=filter2(win,dist,'valid');
+		// dist=dist(1:2:end,1:2:end);
+		downsample(scale, N, *dist[scale-1], dist_levels[scale]);
+		dist[scale] = &dist_levels[scale];
+	}
 
-	// g(sigma1_sq<1e-10)=0;
-	cv::multiply(g, sigma1_sq_th, g);
-	
-	// sv_sq(sigma1_sq<1e-10)=sigma2_sq(sigma1_sq<1e-10);
-	cv::multiply(sv_sq, sigma1_sq_th, sv_sq);
-	cv::multiply(sigma2_sq, 1.0f - sigma1_sq_th, tmp);
-	sv_sq += tmp;
-	
-	// sigma1_sq(sigma1_sq<1e-10)=0;
-	cv::threshold(sigma1_sq, sigma1_sq, EPSILON, 1.0f, cv::THRESH_TOZERO);
-	
-	cv::threshold(sigma2_sq, sigma2_sq_th, EPSILON, 1.0f, cv::THRESH_BINARY);
+	parallelScales([&](int scale, int first, int last, Runner& runner) {
+		// Only the moments that depend on dist are filtered
+		MomentFilter& filter = runner.filters[static_cast<size_t>(scale)];
+		const Scale& s = scales[scale];
+		filter.beginProcessed(s.ref, *dist[scale], first);
+		int w = filter.cols();
+		float *arg = &runner.log_row[0];
+		double *num_terms = &num_rows[offsets[scale]];
 
-	// g(sigma2_sq<1e-10)=0;
-	cv::multiply(g, sigma2_sq_th, g);
-	
-	// sv_sq(sigma2_sq<1e-10)=0;
-	cv::multiply(sv_sq, sigma2_sq_th, sv_sq);
-	
-	cv::threshold(g, g_th, 0.0f, 1.0f, cv::THRESH_BINARY);
+		for (int y=first; y<last; y++) {
+			filter.next();
+			num_terms[y] = compareRow(s.mu1.ptr<float>(y), s.sigma1_sq.ptr<float>(y), filter.row(MOMENT_MU2),
+				filter.row(MOMENT_SQ2), filter.row(MOMENT_12), arg, w);
+		}
+	});
+
+	return float(sumRows(num_rows)/den);
+}
+
+void VIFP::downsample(int scale, int N, const cv::Mat& src, cv::Mat& dst)
+{
+	allocate(dst, (src.rows-(N-1))/2, (src.cols-(N-1))/2);
+	parallel(bands(dst.rows), [&](int i, int runner) {
+		int first, last;
+		band(i, dst.rows, first, last);
+		runner_buffers[static_cast<size_t>(runner)].filters[static_cast<size_t>(scale)].decimate(src, dst, first, last);
+	});
+}
+
+void VIFP::parallelScales(const ScaleBody& body)
+{
+	// The bands of all the subbands are numbered one after the other
+	int first_band[NLEVS+1];
+	first_band[0] = 0;
+	for (int scale=0; scale<NLEVS; scale++) {
+		first_band[scale+1] = first_band[scale] + bands(rows[scale]);
+	}
+
+	parallel(first_band[NLEVS], [&](int i, int runner) {
+		int scale = NLEVS-1;
+		while (first_band[scale] > i) {
+			scale--;
+		}
+		int first, last;
+		band(i-first_band[scale], rows[scale], first, last);
+		body(scale, first, last, runner_buffers[static_cast<size_t>(runner)]);
+	});
+}
+
+double VIFP::prepareRow(const float *mu1, const float *ref_sq, float *sigma1_sq, float *arg, int w)
+{
+	const float EPSILON = 1e-10f;
 	
-	// sv_sq(g<0)=sigma2_sq(g<0);
-	cv::multiply(sv_sq, g_th, sv_sq);
-	cv::multiply(sigma2_sq, 1.0f - g_th, tmp);
-	cv::add(sv_sq, tmp, sv_sq);
+	for (int x=0; x<w; x++) {
+		// sigma1_sq = filter2(win, ref.*ref, 'valid') - mu1_sq;
+		float s1 = ref_sq[x] - mu1[x]*mu1[x];
+		// sigma1_sq(sigma1_sq<0)=0;
+		s1 = s1 > 0.0f ? s1 : 0.0f;
+		sigma1_sq[x] = s1;
+		// sigma1_sq(sigma1_sq<1e-10)=0;
+		float s1_tz = s1 > EPSILON ? s1 : 0.0f;
+		arg[x] = 1.0f + s1_tz / SIGMA_NSQ;
+	}
 	
-	// g(g<0)=0;
-	cv::max(g, 0.0f, g);
+	// den=den+sum(sum(log10(1+sigma1_sq./sigma_nsq)));
+	return sumLog(arg, w);
+}
+
+double VIFP::compareRow(const float *mu1, const float *sigma1_sq, const float *mu2, const float *dist_sq,
+	const float *ref_dist, float *arg, int w)
+{
+	const float EPSILON = 1e-10f;
 	
-	// sv_sq(sv_sq<=1e-10)=1e-10;
-	cv::max(sv_sq, EPSILON, sv_sq);
+	for (int x=0; x<w; x++) {
+		float s1 = sigma1_sq[x];
+		// sigma2_sq = filter2(win, dist.*dist, 'valid') - mu2_sq;
+		float s2 = dist_sq[x] - mu2[x]*mu2[x];
+		// sigma12 = filter2(win, ref.*dist, 'valid') - mu1_mu2;
+		float s12 = ref_dist[x] - mu1[x]*mu2[x];
+		// sigma2_sq(sigma2_sq<0)=0;
+		s2 = s2 > 0.0f ? s2 : 0.0f;
+		// g=sigma12./(sigma1_sq+1e-10);
+		float g = s12 / (s1 + EPSILON);
+		// sv_sq=sigma2_sq-g.*sigma12;
+		float sv_sq = s2 - g*s12;
+		
+		// g(sigma1_sq<1e-10)=0;
+		// sv_sq(sigma1_sq<1e-10)=sigma2_sq(sigma1_sq<1e-10);
+		bool s1_valid = s1 > EPSILON;
+		g = s1_valid ? g : 0.0f;
+		sv_sq = s1_valid ? sv_sq : s2;
+		// sigma1_sq(sigma1_sq<1e-10)=0;
+		float s1_tz = s1_valid ? s1 : 0.0f;
+		
+		// g(sigma2_sq<1e-10)=0;
+		// sv_sq(sigma2_sq<1e-10)=0;
+		bool s2_valid = s2 > EPSILON;
+		g = s2_valid ? g : 0.0f;
+		sv_sq = s2_valid ? sv_sq : 0.0f;
+		
+		// sv_sq(g<0)=sigma2_sq(g<0);
+		sv_sq = g > 0.0f ? sv_sq : s2;
+		// g(g<0)=0;
+		g = g > 0.0f ? g : 0.0f;
+		
+		// sv_sq(sv_sq<=1e-10)=1e-10;
+		sv_sq = sv_sq > EPSILON ? sv_sq : EPSILON;
+		
+		arg[x] = 1.0f + g*g*s1_tz / (sv_sq + SIGMA_NSQ);
+	}
 	
 	// num=num+sum(sum(log10(1+g.^2.*sigma1_sq./(sv_sq+sigma_nsq))));
-	sv_sq += SIGMA_NSQ;
-	cv::multiply(g, g, g);
-	cv::multiply(g, sigma1_sq, g);
-	cv::divide(g, sv_sq, tmp);
-	tmp += 1.0f;
-	cv::log(tmp, tmp);
-	num += cv::sum(tmp)[0] / log(10.0f);
-	
-	// den=den+sum(sum(log10(1+sigma1_sq./sigma_nsq)));
-	tmp = 1.0f + sigma1_sq / SIGMA_NSQ;
-	cv::log(tmp, tmp);
-	den += cv::sum(tmp)[0] / log(10.0f);
+	return sumLog(arg, w);
+}
+
+double VIFP::sumRows(const std::vector<double>& terms)
+{
+	double res = 0.0;
+	for (size_t y=0; y<terms.size(); y++) {
+		res += terms[y];
+	}
+	return res;
+}
+
+double VIFP::sumLog(float *data, int n)
+{
+	for (int x=0; x<n; x++) {
+		data[x] = std::log(data[x]);
+	}
+	return sum(data, n);
 }
@@ -22,9 +22,28 @@
 // maintenance, support, updates, enhancements, or modifications.
 //
 
+#include <limits.h>
 #include "VideoYUV.hpp"
 
-VideoYUV::VideoYUV(const char *f, int h, int w, int nbf, int chroma_format)
+#ifndef _WIN32
+static size_t pagesize()
+{
+	static const size_t PAGESIZE = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+	return PAGESIZE;
+}
+#endif /* _WIN32 */
+
+// Move the file position forward by 'offset' bytes, return false if the stream is not seekable
+static bool seekForward(FILE *file, long long offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, offset, SEEK_CUR) == 0;
+#else
+	return fseeko(file, static_cast<off_t>(offset), SEEK_CUR) == 0;
+#endif /* _WIN32 */
+}
+
+VideoYUV::VideoYUV(const char *f, int h, int w, int nbf, int chroma_format, int bd)
 {
 	if(strcmp(f, "-") == 0)
 		file = stdin;
@@ -39,6 +58,14 @@ VideoYUV::VideoYUV(const char *f, int h, int w, int nbf, int chroma_format)
 	width  = w;
 	nbframes = nbf;
 
+	// Samples above 8 bits are stored on two bytes, in little-endian order
+	if (bd < 8 || bd > 16) {
+		fprintf(stderr, "VideoYUV: the bit depth has to be between 8 and 16.\n");
+		exit(EXIT_FAILURE);
+	}
+	bitdepth = bd;
+	sample_bytes = bd > 8 ? 2 : 1;
+
 	comp_height[0] = h;
 	comp_width [0] = w;
 	if (chroma_format == CHROMA_SUBSAMP_400) {
@@ -69,35 +96,285 @@ VideoYUV::VideoYUV(const char *f, int h, int w, int nbf, int chroma_format)
 		comp_height[2] = comp_height[1] = h;
 		comp_width [2] = comp_width [1] = w;
 	}
-	comp_size[0] = comp_height[0]*comp_width[0];
-	comp_size[1] = comp_height[1]*comp_width[1];
-	comp_size[2] = comp_height[2]*comp_width[2];
+	comp_size[0] = comp_height[0]*comp_width[0]*sample_bytes;
+	comp_size[1] = comp_height[1]*comp_width[1]*sample_bytes;
+	comp_size[2] = comp_height[2]*comp_width[2]*sample_bytes;
 	
 	size = comp_size[0]+comp_size[1]+comp_size[2];
 	
-	data = new imgpel[size];
-	luma = data;
-	chroma[0] = data+comp_size[0];
-	chroma[1] = data+comp_size[0]+comp_size[1];
+	ring_frames = 1;
+	first_frame = 0;
+	stride = 1;
+	nbreads = nbf;
+	next_frame = 0;
+	stream_frame = 0;
+	fetched = 0;
+	released = 0;
+	failed = false;
+	ended = false;
+	truncated = false;
+	stop = false;
+	touched = 0;
+	luma_only = false;
+	seekable = false;
+	retained = 0;
+
+	map = NULL;
+	map_size = 0;
+	if (mapFile()) {
+		data = NULL;
+	}
+	else {
+		data = new imgpel[size];
+		// Pipes cannot seek, skipped samples are drained instead
+		seekable = seekForward(file, 0);
+	}
+	setPlanes(0);
 }
 
 VideoYUV::~VideoYUV()
 {
+	if (reader.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+		cond.notify_all();
+		reader.join();
+	}
+#ifndef _WIN32
+	if (map != NULL) {
+		munmap(map, map_size);
+	}
+#endif /* _WIN32 */
 	delete[] data;
 	fclose(file);
 }
 
+bool VideoYUV::mapFile()
+{
+#ifndef _WIN32
+	struct stat st;
+	if (file == stdin || fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+		return false;
+	}
+	// Files larger than the address space are read through the stream
+	if (static_cast<unsigned long long>(st.st_size) > static_cast<unsigned long long>(static_cast<size_t>(-1))) {
+		return false;
+	}
+
+	void *ptr = mmap(NULL, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (ptr == MAP_FAILED) {
+		return false;
+	}
+	map = static_cast<imgpel*>(ptr);
+	map_size = static_cast<size_t>(st.st_size);
+	madvise(map, map_size, MADV_SEQUENTIAL);
+	return true;
+#else
+	return false;
+#endif /* _WIN32 */
+}
+
+void VideoYUV::setLumaOnly(bool enable)
+{
+	luma_only = enable && comp_size[1] > 0;
+	if (!luma_only) {
+		return;
+	}
+
+	if (map != NULL) {
+#ifndef _WIN32
+		// Only the luma pages are requested explicitly, sequential readahead would fetch chroma too
+		madvise(map, map_size, MADV_RANDOM);
+#endif /* _WIN32 */
+	}
+	setPlanes(next_frame);
+}
+
+void VideoYUV::setRange(long start, long end, int step)
+{
+	first_frame = start;
+	stride = step;
+	if (end < 0) {
+		nbreads = LONG_MAX;
+	}
+	else {
+		nbreads = end > start ? (end-start+step-1) / step : 0;
+	}
+	setPlanes(next_frame);
+}
+
+void VideoYUV::prefetch(int depth)
+{
+	if (reader.joinable() || depth < 1) {
+		return;
+	}
+
+	// Frames are read into a ring of buffers, mapped frames are faulted in place
+	ring_frames = depth;
+	if (map == NULL) {
+		delete[] data;
+		data = new imgpel[static_cast<size_t>(size)*static_cast<size_t>(depth)];
+	}
+	reader = std::thread(&VideoYUV::readFrames, this);
+}
+
+void VideoYUV::setRetained(int frames)
+{
+	retained = frames;
+}
+
 bool VideoYUV::readOneFrame()
 {
-	imgpel *ptr_data = data;
+	long k = next_frame;
+
+	if (reader.joinable()) {
+		std::unique_lock<std::mutex> lock(mutex);
+		// The previous frame has been consumed, its buffer can be reused
+		released = k;
+		cond.notify_all();
+		while (fetched <= k && !failed) {
+			cond.wait(lock);
+		}
+		if (fetched <= k) {
+			return false;
+		}
+	}
+	else if (!fetchFrame(k)) {
+		return false;
+	}
+
+	// The previous frames have been consumed and do not need to stay resident
+	if (map != NULL && k > retained) {
+		adviseFrame(k-1-retained, false);
+	}
+
+	setPlanes(k);
+	next_frame++;
+	return true;
+}
+
+void VideoYUV::readFrames()
+{
+	for (long k=next_frame; k<nbreads; k++) {
+		{
+			// Wait for a free buffer
+			std::unique_lock<std::mutex> lock(mutex);
+			while (!stop && k >= released+ring_frames) {
+				cond.wait(lock);
+			}
+			if (stop) {
+				return;
+			}
+		}
+
+		bool ok = fetchFrame(k);
+#ifndef _WIN32
+		if (ok && map != NULL) {
+			// Fault the frame in now, rather than when it is converted
+			const imgpel *ptr = frameData(k);
+			size_t needed = static_cast<size_t>(luma_only ? comp_size[0] : size);
+			unsigned int sum = 0;
+			for (size_t i=0; i<needed; i+=pagesize()) {
+				sum += ptr[i];
+			}
+			touched += sum;
+		}
+#endif /* _WIN32 */
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (ok) {
+				fetched = k+1;
+			}
+			else {
+				failed = true;
+			}
+		}
+		cond.notify_all();
+		if (!ok) {
+			return;
+		}
+	}
+}
+
+long long VideoYUV::framePosition(long k) const
+{
+	return (first_frame + static_cast<long long>(k)*stride) * size;
+}
+
+bool VideoYUV::fetchFrame(long k)
+{
+	if (map != NULL) {
+		size_t frame_size = static_cast<size_t>(size);
+		unsigned long long offset = static_cast<unsigned long long>(framePosition(k));
+		if (offset >= map_size) {
+			ended = true;
+			return false;
+		}
+		if (map_size - offset < frame_size) {
+			truncated = true;
+			return false;
+		}
+		// The next frame will be needed soon
+		if (k == 0) {
+			adviseFrame(k, true);
+		}
+		unsigned long long next = static_cast<unsigned long long>(framePosition(k+1));
+		if (k+1 < nbreads && next <= map_size && map_size - next >= frame_size) {
+			adviseFrame(k+1, true);
+		}
+		return true;
+	}
+
+	imgpel *ptr_data = frameData(k);
+
+	// Skip the frames that are not returned
+	long frame = static_cast<long>(first_frame + static_cast<long long>(k)*stride);
+	if (stream_frame < frame) {
+		if (streamEnded()) {
+			ended = true;
+			return false;
+		}
+		if (seekable) {
+			if (!seekForward(file, static_cast<long long>(frame-stream_frame)*size)) {
+				fprintf(stderr, "readOneFrame: cannot skip frames in input file.\n");
+				return false;
+			}
+		}
+		else {
+			for (long i=stream_frame; i<frame; i++) {
+				if (i > stream_frame && streamEnded()) {
+					ended = true;
+					return false;
+				}
+				if (fread(ptr_data, 1, static_cast<size_t>(size), file) != static_cast<size_t>(size)) {
+					readFailed(size);
+					return false;
+				}
+			}
+		}
+	}
+	if (streamEnded()) {
+		ended = true;
+		return false;
+	}
+	stream_frame = frame+1;
 
 	for (int j=0; j<3; j++) {
-		int read_size = comp_width[j];
+		int read_size = comp_width[j]*sample_bytes;
 		if (read_size <= 0)
 			continue;
+		if (j > 0 && luma_only && seekable) {
+			if (!seekForward(file, static_cast<long long>(comp_size[1])+comp_size[2])) {
+				fprintf(stderr, "readOneFrame: cannot skip chroma samples in input file.\n");
+				return false;
+			}
+			break;
+		}
 		for (int i=0; i<comp_height[j]; i++) {
 			if (fread(ptr_data, 1, static_cast<size_t>(read_size), file) != static_cast<size_t>(read_size)) {
-				fprintf(stderr, "readOneFrame: cannot read %d bytes from input file, unexpected EOF.\n", read_size);
+				readFailed(read_size);
 				return false;
 			}
 			ptr_data += read_size;
@@ -106,13 +383,130 @@ bool VideoYUV::readOneFrame()
 	return true;
 }
 
+bool VideoYUV::streamEnded()
+{
+	int c = getc(file);
+	if (c == EOF) {
+		// Read errors are reported by the following read
+		return !ferror(file);
+	}
+	ungetc(c, file);
+	return false;
+}
+
+void VideoYUV::readFailed(int bytes)
+{
+	if (ferror(file)) {
+		fprintf(stderr, "readOneFrame: cannot read %d bytes from input file.\n", bytes);
+	}
+	else {
+		truncated = true;
+	}
+}
+
+imgpel* VideoYUV::frameData(long k)
+{
+	if (map != NULL) {
+		return map + static_cast<size_t>(framePosition(k));
+	}
+	return data + static_cast<size_t>(k % ring_frames)*static_cast<size_t>(size);
+}
+
+void VideoYUV::setPlanes(long k)
+{
+	luma = frameData(k);
+	if (luma_only) {
+		chroma[0] = chroma[1] = NULL;
+	}
+	else {
+		chroma[0] = luma+comp_size[0];
+		chroma[1] = luma+comp_size[0]+comp_size[1];
+	}
+}
+
+void VideoYUV::adviseFrame(long k, bool needed)
+{
+#ifndef _WIN32
+	// Only the planes that are used matter
+	size_t offset = static_cast<size_t>(framePosition(k));
+	size_t length = static_cast<size_t>(luma_only ? comp_size[0] : size);
+	size_t start = offset / pagesize() * pagesize();
+	madvise(map + start, offset+length-start, needed ? MADV_WILLNEED : MADV_DONTNEED);
+#else
+	(void)k;
+	(void)needed;
+#endif /* _WIN32 */
+}
+
 void VideoYUV::getLuma(cv::Mat& local_luma, int type)
 {
-	cv::Mat tmp(height, width, CV_8UC1, this->luma);
-	if (type == CV_8UC1) {
-		tmp.copyTo(local_luma);
+	getPlane(PLANE_Y, local_luma, type);
+}
+
+void VideoYUV::getPlane(int plane, cv::Mat& component, int type)
+{
+	imgpel *ptr = plane == PLANE_Y ? luma : chroma[plane-1];
+	int native = sample_bytes == 2 ? CV_16UC1 : CV_8UC1;
+	cv::Mat tmp(comp_height[plane], comp_width[plane], native, ptr);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if (sample_bytes == 2) {
+		// Samples are stored in little-endian order
+		cv::Mat swapped(comp_height[plane], comp_width[plane], CV_16UC1);
+		for (int y=0; y<tmp.rows; y++) {
+			const unsigned short *src = tmp.ptr<unsigned short>(y);
+			unsigned short *dst = swapped.ptr<unsigned short>(y);
+			for (int x=0; x<tmp.cols; x++) {
+				dst[x] = static_cast<unsigned short>((src[x] >> 8) | (src[x] << 8));
+			}
+		}
+		tmp = swapped;
+	}
+#endif
+	if (type < 0 || type == native) {
+		tmp.copyTo(component);
 	}
 	else {
-		tmp.convertTo(local_luma, type);
+		tmp.convertTo(component, type);
+	}
+}
+
+bool VideoYUV::referPlane(int plane, cv::Mat& component)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	// Samples above 8 bits are swapped by getPlane()
+	if (sample_bytes == 2) {
+		return false;
 	}
+#endif
+	if (map == NULL) {
+		return false;
+	}
+	imgpel *ptr = plane == PLANE_Y ? luma : chroma[plane-1];
+	component = cv::Mat(comp_height[plane], comp_width[plane], sample_bytes == 2 ? CV_16UC1 : CV_8UC1, ptr);
+	return true;
+}
+
+int VideoYUV::getBitDepth() const
+{
+	return bitdepth;
+}
+
+bool VideoYUV::hasEnded() const
+{
+	return ended;
+}
+
+bool VideoYUV::isTruncated() const
+{
+	return truncated;
+}
+
+int VideoYUV::getHeight(int plane) const
+{
+	return comp_height[plane];
+}
+
+int VideoYUV::getWidth(int plane) const
+{
+	return comp_width[plane];
 }
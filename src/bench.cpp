@@ -0,0 +1,346 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Usage:
+  vqmt_bench [Options]
+
+  Measures the time taken by each building block of VQMT on synthetic frames,
+  and prints one line per kernel and resolution in CSV (comma-separated values)
+  format on the standard output:
+   kernel,resolution,width,height,iterations,ns_per_pixel,frames_per_s,bytes_per_s
+
+  Options:
+   - -kernels LIST: comma-separated list of kernels to measure (default: all)
+     available kernels:
+     - psnr: PSNR::compute on 8-bit frames
+     - ssim: SSIM::computeSSIM
+     - msssim: MSSSIM::compute
+     - vifp: VIFP::compute
+     - psnrhvs: PSNRHVS::compute (PSNR-HVS and PSNR-HVS-M)
+     - blur: Metric::applyGaussianBlur with the 11x11 window of SSIM
+     - read: VideoYUV::readOneFrame followed by VideoYUV::getLuma, on a YUV420 file
+   - -resolutions LIST: comma-separated list of resolutions (default: all)
+     available resolutions: 480p (720x480), 720p (1280x720), 1080p (1920x1088),
+     2160p (3840x2160), 4320p (7680x4320)
+   - -time S: minimum measurement time in seconds for each line (default: 1)
+   - -file PATH: temporary YUV file written for the read kernel (default: vqmt_bench.yuv)
+   - -isa NAME: instruction set of the vectorized kernels, generic, sse2, avx2 or avx512
+     (default: the best one supported by the processor), to compare them
+   - -threads N: number of threads computing each frame in bands of rows, including the
+     calling one (default: 1), to measure the latency of one frame as with vqmt -intra
+
+ Notes:
+ - The reported time is the median of at least 3 iterations, after one warm-up iteration
+ - bytes_per_s counts the input samples of one frame pair (one frame for blur
+   and read), as stored in memory: 1 byte per sample for psnr and read, 4 bytes
+   (CV_32F) for the other kernels
+ - 1080p is rounded up to 1088 lines, as MS-SSIM needs a multiple of 16
+ - The YUV file of the read kernel is in the page cache, so the read kernel
+   measures the reading overhead of VQMT rather than the storage
+
+**************************************************************************/
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <opencv2/core/core.hpp>
+#include "PSNR.hpp"
+#include "SSIM.hpp"
+#include "MSSSIM.hpp"
+#include "VIFP.hpp"
+#include "PSNRHVS.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+#include "VideoYUV.hpp"
+
+enum Kernels {
+	KERNEL_PSNR = 0,
+	KERNEL_SSIM,
+	KERNEL_MSSSIM,
+	KERNEL_VIFP,
+	KERNEL_PSNRHVS,
+	KERNEL_BLUR,
+	KERNEL_READ,
+	KERNEL_SIZE
+};
+
+static const char *KERNEL_NAME[KERNEL_SIZE] = {"psnr", "ssim", "msssim", "vifp", "psnrhvs", "blur", "read"};
+
+struct Resolution {
+	const char *name;
+	int width;
+	int height;
+};
+
+static const int RESOLUTION_SIZE = 5;
+static const Resolution RESOLUTION[RESOLUTION_SIZE] = {
+	{"480p", 720, 480},
+	{"720p", 1280, 720},
+	{"1080p", 1920, 1088},
+	{"2160p", 3840, 2160},
+	{"4320p", 7680, 4320}
+};
+
+// Number of frames in the YUV file of the read kernel
+static const int READ_FRAMES = 4;
+
+// Gives access to the protected building blocks of SSIM
+class BenchSSIM : public SSIM {
+public:
+	BenchSSIM(int h, int w) : SSIM(h, w) {}
+	using SSIM::computeSSIM;
+	using Metric::applyGaussianBlur;
+};
+
+// Check whether 'name' is one of the comma-separated entries of 'list'
+static bool inList(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *entry = list;
+	while (entry != NULL) {
+		const char *end = strchr(entry, ',');
+		size_t entry_len = end != NULL ? static_cast<size_t>(end-entry) : strlen(entry);
+		if (entry_len == len && strncmp(entry, name, len) == 0) {
+			return true;
+		}
+		entry = end != NULL ? end+1 : NULL;
+	}
+	return false;
+}
+
+// Deterministic pseudo-random generator, so that all builds measure the same frames
+static unsigned int nextRandom(unsigned int& state)
+{
+	state = state*1664525u + 1013904223u;
+	return state >> 8;
+}
+
+// Textured original frame and noisy processed frame, with 8-bit samples
+static void makeFrames(int height, int width, cv::Mat& original, cv::Mat& processed)
+{
+	original.create(height, width, CV_8UC1);
+	processed.create(height, width, CV_8UC1);
+	unsigned int state = 1;
+	for (int y=0; y<height; y++) {
+		unsigned char *org = original.ptr<unsigned char>(y);
+		unsigned char *prc = processed.ptr<unsigned char>(y);
+		for (int x=0; x<width; x++) {
+			double value = 128.0 + 64.0*sin(0.05*x)*cos(0.03*y) + static_cast<double>(nextRandom(state) % 33) - 16.0;
+			double noise = static_cast<double>(nextRandom(state) % 17) - 8.0;
+			org[x] = cv::saturate_cast<unsigned char>(value);
+			prc[x] = cv::saturate_cast<unsigned char>(value + noise);
+		}
+	}
+}
+
+// Write a YUV420 file of 'nbframes' copies of 'luma', with flat chroma
+static bool writeFile(const char *path, const cv::Mat& luma, int nbframes)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		return false;
+	}
+	std::vector<unsigned char> chroma(static_cast<size_t>(luma.rows/2)*static_cast<size_t>(luma.cols/2)*2, 128);
+	bool ok = true;
+	for (int k=0; k<nbframes && ok; k++) {
+		for (int y=0; y<luma.rows && ok; y++) {
+			ok = fwrite(luma.ptr<unsigned char>(y), 1, static_cast<size_t>(luma.cols), file) == static_cast<size_t>(luma.cols);
+		}
+		ok = ok && fwrite(&chroma[0], 1, chroma.size(), file) == chroma.size();
+	}
+	return fclose(file) == 0 && ok;
+}
+
+// Median time in seconds of one call to 'run', repeated for at least 'min_time' seconds
+static double measure(const std::function<void()>& run, double min_time, int& iterations)
+{
+	// Warm-up: caches, page faults and lazy allocations
+	run();
+
+	std::vector<double> times;
+	double total = 0.0;
+	while (times.size() < 3 || total < min_time) {
+		double start = static_cast<double>(cv::getTickCount());
+		run();
+		double time = (static_cast<double>(cv::getTickCount())-start) / cv::getTickFrequency();
+		times.push_back(time);
+		total += time;
+	}
+	iterations = static_cast<int>(times.size());
+	std::sort(times.begin(), times.end());
+	return times[times.size()/2];
+}
+
+int main (int argc, const char *argv[])
+{
+	const char *kernels = NULL;
+	const char *resolutions = NULL;
+	const char *path = "vqmt_bench.yuv";
+	double min_time = 1.0;
+	int nbthreads = 1;
+
+	char *endptr = NULL;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "-kernels") == 0 && i+1 < argc) {
+			kernels = argv[++i];
+		}
+		else if (strcmp(argv[i], "-resolutions") == 0 && i+1 < argc) {
+			resolutions = argv[++i];
+		}
+		else if (strcmp(argv[i], "-time") == 0 && i+1 < argc) {
+			min_time = strtod(argv[++i], &endptr);
+			if (*endptr || min_time < 0.0) {
+				fprintf(stderr, "Incorrect value for measurement time: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-threads") == 0 && i+1 < argc) {
+			nbthreads = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || nbthreads < 1) {
+				fprintf(stderr, "Incorrect value for number of threads: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-file") == 0 && i+1 < argc) {
+			path = argv[++i];
+		}
+		else if (strcmp(argv[i], "-isa") == 0 && i+1 < argc) {
+			int isa = Simd::find(argv[++i]);
+			if (isa < 0 || !Simd::select(isa)) {
+				fprintf(stderr, "Unsupported instruction set: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else {
+			fprintf(stderr, "Unknown option: %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// The calling thread computes bands too
+	ThreadPool *pool = nbthreads > 1 ? new ThreadPool(nbthreads-1) : NULL;
+
+	printf("kernel,resolution,width,height,iterations,ns_per_pixel,frames_per_s,bytes_per_s\n");
+
+	for (int r=0; r<RESOLUTION_SIZE; r++) {
+		const Resolution& res = RESOLUTION[r];
+		if (resolutions != NULL && !inList(resolutions, res.name)) {
+			continue;
+		}
+		const int height = res.height;
+		const int width = res.width;
+		const double pixels = static_cast<double>(width)*height;
+
+		cv::Mat original, processed;
+		makeFrames(height, width, original, processed);
+		cv::Mat original_frame, processed_frame;
+		original.convertTo(original_frame, CV_32F);
+		processed.convertTo(processed_frame, CV_32F);
+
+		for (int k=0; k<KERNEL_SIZE; k++) {
+			if (kernels != NULL && !inList(kernels, KERNEL_NAME[k])) {
+				continue;
+			}
+
+			// One call to 'run' computes 'frames' frames of 'bytes' bytes each
+			std::function<void()> run;
+			int frames = 1;
+			double bytes = 2*pixels*sizeof(float);
+			PSNR psnr(height, width);
+			BenchSSIM ssim(height, width);
+			MSSSIM *msssim = NULL;
+			VIFP *vifp = NULL;
+			PSNRHVS *phvs = NULL;
+			cv::Mat blurred;
+			cv::Mat luma;
+			psnr.setPool(pool);
+			ssim.setPool(pool);
+			switch (k) {
+			case KERNEL_PSNR:
+				bytes = 2*pixels;
+				run = [&]() { psnr.compute(original, processed); };
+				break;
+			case KERNEL_SSIM:
+				run = [&]() { ssim.computeSSIM(original_frame, processed_frame, NULL); };
+				break;
+			case KERNEL_MSSSIM:
+				msssim = new MSSSIM(height, width);
+				msssim->setPool(pool);
+				run = [&]() { msssim->compute(original_frame, processed_frame); };
+				break;
+			case KERNEL_VIFP:
+				vifp = new VIFP(height, width);
+				vifp->setPool(pool);
+				run = [&]() { vifp->compute(original_frame, processed_frame); };
+				break;
+			case KERNEL_PSNRHVS:
+				phvs = new PSNRHVS(height, width);
+				phvs->setPool(pool);
+				run = [&]() { phvs->compute(original_frame, processed_frame); };
+				break;
+			case KERNEL_BLUR:
+				bytes = pixels*sizeof(float);
+				run = [&]() { ssim.applyGaussianBlur(original_frame, blurred, 11, 1.5); };
+				break;
+			case KERNEL_READ:
+				if (!writeFile(path, original, READ_FRAMES)) {
+					fprintf(stderr, "Cannot write temporary file: %s\n", path);
+					return EXIT_FAILURE;
+				}
+				frames = READ_FRAMES;
+				bytes = pixels*3/2;
+				run = [&]() {
+					VideoYUV video(path, height, width, READ_FRAMES, CHROMA_SUBSAMP_420);
+					for (int f=0; f<READ_FRAMES; f++) {
+						if (!video.readOneFrame()) exit(EXIT_FAILURE);
+						video.getLuma(luma);
+					}
+				};
+				break;
+			default:
+				break;
+			}
+
+			int iterations = 0;
+			double time = measure(run, min_time, iterations) / frames;
+			printf("%s,%s,%d,%d,%d,%.4f,%.3f,%.0f\n", KERNEL_NAME[k], res.name, width, height, iterations,
+				time*1e9/pixels, 1.0/time, bytes/time);
+			fflush(stdout);
+
+			delete msssim;
+			delete vifp;
+			delete phvs;
+			if (k == KERNEL_READ) {
+				remove(path);
+			}
+		}
+	}
+
+	delete pool;
+	return EXIT_SUCCESS;
+}
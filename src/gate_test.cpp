@@ -0,0 +1,156 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+/**************************************************************************
+
+ Usage:
+  vqmt_gate_test
+
+  Checks the verdicts of QualityGate on sequences of quality indexes, and
+  prints the failed checks on the standard error.
+  Returns EXIT_SUCCESS if all checks pass, EXIT_FAILURE otherwise.
+  Run by ctest.
+
+**************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits>
+#include "PSNR.hpp"
+#include "QualityGate.hpp"
+
+static int failures = 0;
+
+static void expect(bool condition, const char *check)
+{
+	if (!condition) {
+		fprintf(stderr, "FAILED: %s\n", check);
+		failures++;
+	}
+}
+
+// Check the PSNR of consecutive frames of one processed video, luma only
+static void checkPSNR(QualityGate& gate, const float *psnr, int nbframes)
+{
+	float result[PLANE_SIZE][METRIC_SIZE] = {{0.0f}};
+	for (int frame=0; frame<nbframes; frame++) {
+		result[PLANE_Y][METRIC_PSNR] = psnr[frame];
+		gate.check(frame, 0, result);
+	}
+}
+
+int main()
+{
+	const float inf = std::numeric_limits<float>::infinity();
+
+	// Frames above the window floor
+	{
+		QualityGate gate;
+		gate.setWindow(METRIC_PSNR, 2, 40.0f);
+		gate.start(1, 1);
+		const float psnr[] = {45.0f, 38.0f, 45.0f, 38.0f};
+		checkPSNR(gate, psnr, 4);
+		expect(!gate.isRejected(), "window mean above the floor");
+	}
+
+	// Frames below the window floor
+	{
+		QualityGate gate;
+		gate.setWindow(METRIC_PSNR, 2, 40.0f);
+		gate.start(1, 1);
+		const float psnr[] = {45.0f, 38.0f, 30.0f};
+		checkPSNR(gate, psnr, 3);
+		expect(gate.isRejected(), "window mean below the floor");
+	}
+
+	// Identical frame (infinite PSNR) inside the window, followed by bad frames
+	{
+		QualityGate gate;
+		gate.setWindow(METRIC_PSNR, 2, 40.0f);
+		gate.setMaxIndex(METRIC_PSNR, PSNR::maxIndex(288, 352, 8));
+		gate.start(1, 1);
+		const float psnr[] = {45.0f, inf, 30.0f};
+		checkPSNR(gate, psnr, 3);
+		expect(!gate.isRejected(), "identical frame inside the window");
+		float result[PLANE_SIZE][METRIC_SIZE] = {{0.0f}};
+		result[PLANE_Y][METRIC_PSNR] = 30.0f;
+		gate.check(3, 0, result);
+		expect(gate.isRejected(), "bad frames after an identical frame left the window");
+	}
+
+	// Identical frame (infinite PSNR) inside a window of bad frames
+	{
+		QualityGate gate;
+		gate.setWindow(METRIC_PSNR, 5, 30.0f);
+		gate.setMaxIndex(METRIC_PSNR, PSNR::maxIndex(288, 352, 8));
+		gate.start(1, 1);
+		const float psnr[] = {inf, 7.7f, 7.7f, 7.7f, 7.7f};
+		checkPSNR(gate, psnr, 5);
+		expect(gate.isRejected(), "identical frame inside a window of bad frames");
+	}
+
+	// Per-frame floor and maximum number of bad frames
+	{
+		QualityGate gate;
+		gate.setFloor(METRIC_PSNR, 35.0f);
+		gate.setMaxBad(1);
+		gate.start(1, 1);
+		const float psnr[] = {40.0f, 30.0f, inf, 40.0f};
+		checkPSNR(gate, psnr, 4);
+		expect(!gate.isRejected(), "one bad frame allowed");
+		float result[PLANE_SIZE][METRIC_SIZE] = {{0.0f}};
+		result[PLANE_Y][METRIC_PSNR] = 30.0f;
+		gate.check(4, 0, result);
+		expect(gate.isRejected(), "second bad frame");
+	}
+
+	// Quality index that is not a number
+	{
+		QualityGate gate;
+		gate.setFloor(METRIC_PSNR, 35.0f);
+		gate.start(1, 1);
+		const float psnr[] = {40.0f, std::numeric_limits<float>::quiet_NaN()};
+		checkPSNR(gate, psnr, 2);
+		expect(gate.isRejected(), "NaN below the floor");
+	}
+
+	// Two processed videos, only the first one rejected
+	{
+		QualityGate gate;
+		gate.setFloor(METRIC_PSNR, 35.0f);
+		gate.start(2, 1);
+		float result[PLANE_SIZE][METRIC_SIZE] = {{0.0f}};
+		result[PLANE_Y][METRIC_PSNR] = 30.0f;
+		gate.check(0, 0, result);
+		result[PLANE_Y][METRIC_PSNR] = 40.0f;
+		gate.check(0, 1, result);
+		expect(gate.isRejected() && gate.isRejected(0), "first video rejected");
+		expect(!gate.isRejected(1) && !gate.allRejected(), "second video still checked");
+		result[PLANE_Y][METRIC_PSNR] = 30.0f;
+		gate.check(1, 1, result);
+		expect(gate.allRejected(), "both videos rejected");
+	}
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -25,13 +25,13 @@
 /**************************************************************************
 
  Usage:
-  VQMT.exe OriginalVideo ProcessedVideo Height Width NumberOfFrames ChromaFormat Output Metrics
+  VQMT.exe OriginalVideo ProcessedVideo Height Width NumberOfFrames ChromaFormat Output Metrics [Options]
 
-  OriginalVideo: the original video as raw YUV video file, progressively scanned, and 8 bits per sample
-  ProcessedVideo: the processed video as raw YUV video file, progressively scanned, and 8 bits per sample
+  OriginalVideo: the original video as raw YUV video file, progressively scanned, and 8 bits per sample (see -bitdepth)
+  ProcessedVideo: the processed video as raw YUV video file, progressively scanned, and 8 bits per sample (see -bitdepth)
   Height: the height of the video
   Width: the width of the video
-  NumberOfFrames: the number of frames to process
+  NumberOfFrames: the number of frames to process (0 with -stream to process all the frames)
   ChromaFormat: the chroma subsampling format. 0: YUV400, 1: YUV420, 2: YUV422, 3: YUV444
   Output: the name of the output file(s)
   Metrics: the list of metrics to use
@@ -43,6 +43,50 @@
    - PSNRHVS: Peak Signal-to-Noise Ratio taking into account Contrast Sensitivity Function (CSF) (PSNR-HVS)
    - PSNRHVSM: Peak Signal-to-Noise Ratio taking into account Contrast Sensitivity Function (CSF) and between-coefficient contrast masking of DCT basis functions (PSNR-HVS-M)
 
+  Options:
+   - -threads N: number of frames computed in parallel (default: number of hardware threads)
+   - -prefetch N: number of frames read ahead in the background for each video, 0 to disable (default: 4)
+   - -chroma: compute the metrics on the three components, the output files then contain one column
+     per component (y, u, v) and the 6:1:1 weighted combination (yuv)
+   - -processed FILE OUTPUT: compare another processed video to the original video, with results
+     written to OUTPUT_*.csv (can be repeated); the original video is read once and its statistics
+     are computed once per frame for all processed videos
+   - -start N: first frame to compute (default: 0)
+   - -end N: last frame to compute, included (default: NumberOfFrames-1)
+   - -stride N: only compute every N-th frame from the first one (default: 1); the averages are
+     computed over the computed frames
+   - -bitdepth N: number of bits per sample, from 8 to 16 (default: 8); samples above 8 bits are
+     stored on two bytes in little-endian order
+   - -stream: read the videos (e.g. pipes) until the shortest one ends, without reporting an error
+     when they hold fewer frames than NumberOfFrames; the results of each frame are written and
+     flushed as soon as they are computed, and the averages when the videos end (a partial last
+     frame, e.g. from an interrupted producer, is ignored with a warning)
+   - -floor METRIC VALUE: frames with a quality index below VALUE are bad (can be repeated for
+     several metrics)
+   - -window METRIC N VALUE: reject a processed video when the mean quality index over N
+     consecutive frames is below VALUE; the infinite PSNR of an identical frame counts as
+     the PSNR of frames differing by one in a single sample
+   - -maxbad N: reject a processed video when more than N frames are bad (default: 0), needs
+     -floor
+     Once a processed video is rejected, its frames are not read nor compared anymore, the
+     other ones are still computed; no more frames are read once all processed videos are
+     rejected, and the program exits with status 2 after printing the offending frames
+   - -format F: format of the output files (default: split)
+     - split: one CSV file per metric, Output_metric.csv
+     - csv: a single CSV file with one column per metric, Output.csv
+     - binary: a single binary file with one column per metric, Output.bin (see ResultWriter.hpp)
+   - -isa NAME: instruction set of the vectorized kernels, generic, sse2, avx2 or avx512
+     (default: the best one supported by the processor)
+   - -maps: also write per-block maps of the luma component to Output_maps.bin (see ResultWriter.hpp):
+     the means of the SSIM map over blocks of 16x16 windows with SSIM, and the PSNR-HVS-M errors
+     of the 8x8 blocks with PSNRHVSM
+   - -intra: also split each frame into bands of rows computed in parallel by all the threads, to
+     lower the latency of each frame (e.g. with -stream); at most two frames are then computed at
+     once, and the results are the same as without -intra
+   - -cache N: number of distinct pairs of original and processed frames whose quality indexes are
+     kept for each component, to skip the computation of repeated frames (e.g. still scenes or
+     looped content), 0 to disable (default: 16); frames are matched on a 128-bit fingerprint
+
  Example:
   VQMT.exe original.yuv processed.yuv 1088 1920 250 1 results PSNR SSIM MSSSIM VIFP
   will create the following output files in CSV (comma-separated values) format:
@@ -55,7 +99,18 @@
  - SSIM comes for free when MSSSIM is computed (but you still need to specify it to get the output)
  - PSNRHVS and PSNRHVSM are always computed at the same time (but you still need to specify both to get the two outputs)
  - When using MSSSIM, the height and width of the video have to be multiple of 16
- - When using VIFP, the height and width of the video have to be multiple of 8
+ - When using VIFP, the height and width of the video have to be multiple of 8, and at least 72
+ - When using SSIM, the height and width of the video have to be at least 11 (176 with MSSSIM)
+ - When using PSNRHVS or PSNRHVSM, the height and width of the video have to be multiple of 8
+ - With -chroma, these constraints also apply to the dimensions of the chroma components
+ - A report of the run is written to Output_report.json: for each stage (read, copy, convert, hash, psnr,
+   ssim, msssim, vifp, psnrhvs, wait, frame, write), the number of samples and the total, mean, p50, p95, p99 and
+   maximum times in seconds
+ - Above 8 bits, PSNR uses a peak value of 255 scaled to the bit depth (e.g. 1020 for 10 bits), and
+   the samples are scaled down to the 8-bit range for the other metrics
+ - Identical original and processed components are detected and get the quality indexes of a
+   perfect match without computing them (PSNR inf, SSIM and MSSSIM 1, PSNRHVS and PSNRHVSM 100000),
+   only VIFP is still computed; the report counts them, with the hits and misses of -cache
 
  Changes in version 1.1 (since 1.0) on 30/3/13
  - Added support for large files (>2GB)
@@ -64,15 +119,24 @@
 **************************************************************************/
 
 #include <iostream>
+#include <vector>
 #include <stdio.h>
 #include <string.h>
 #include <opencv2/core/core.hpp>
 #include "VideoYUV.hpp"
-#include "PSNR.hpp"
-#include "SSIM.hpp"
-#include "MSSSIM.hpp"
-#include "VIFP.hpp"
-#include "PSNRHVS.hpp"
+#include "Evaluator.hpp"
+#include "FrameEngine.hpp"
+#include "Profile.hpp"
+#include "QualityGate.hpp"
+#include "ResultWriter.hpp"
+#include "Simd.hpp"
+
+// Names of the metrics and of the output formats on the command line
+static const char *METRIC_NAME[METRIC_SIZE] = {"PSNR", "SSIM", "MSSSIM", "VIFP", "PSNRHVS", "PSNRHVSM"};
+static const char *FORMAT_NAME[FORMAT_SIZE] = {"split", "csv", "binary"};
+
+// Exit status when a processed video is rejected by the quality thresholds
+static const int EXIT_REJECTED = 2;
 
 enum Params {
 	PARAM_ORIGINAL = 1,	// Original video stream (YUV)
@@ -86,14 +150,48 @@ enum Params {
 	PARAM_SIZE
 };
 
-enum Metrics {
-	METRIC_PSNR = 0,
-	METRIC_SSIM,
-	METRIC_MSSSIM,
-	METRIC_VIFP,
-	METRIC_PSNRHVS,
-	METRIC_PSNRHVSM,
-	METRIC_SIZE
+// Index of a metric from its name on the command line, -1 if unknown
+static int findMetric(const char *name)
+{
+	for (int m=0; m<METRIC_SIZE; m++) {
+		if (strcmp(name, METRIC_NAME[m]) == 0) {
+			return m;
+		}
+	}
+	return -1;
+}
+
+// Read the next frame of a video
+// Returns false at the end of the video when streaming, exits on any other failure
+static bool readFrame(VideoYUV *video, const char *path, int frame, bool stream)
+{
+	if (video->readOneFrame()) {
+		return true;
+	}
+	if (video->isTruncated()) {
+		// e.g. the producer of a pipe was interrupted in the middle of a frame
+		if (!stream) {
+			fprintf(stderr, "readOneFrame: unexpected EOF inside frame %d of %s.\n", frame, path);
+			exit(EXIT_FAILURE);
+		}
+		fprintf(stderr, "Warning: %s ends inside frame %d, the partial frame is ignored.\n", path, frame);
+		return false;
+	}
+	if (!video->hasEnded()) {
+		exit(EXIT_FAILURE);
+	}
+	if (!stream) {
+		fprintf(stderr, "readOneFrame: unexpected end of %s at frame %d.\n", path, frame);
+		exit(EXIT_FAILURE);
+	}
+	return false;
+}
+
+// Processed video
+struct Rendition {
+	const char *path;	// processed video stream (YUV)
+	const char *output;	// output file(s) for results
+	VideoYUV *video;
 };
 
 int main (int argc, const char *argv[])
@@ -129,138 +227,378 @@ int main (int argc, const char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	// Input video streams
-	VideoYUV *original  = new VideoYUV(argv[PARAM_ORIGINAL], height, width, nbframes, chroma);
-	VideoYUV *processed = new VideoYUV(argv[PARAM_PROCESSED], height, width, nbframes, chroma);
+	// Processed videos, the first one is given by the parameters, the others by options
+	std::vector<Rendition> renditions(1);
+	renditions[0].path = argv[PARAM_PROCESSED];
+	renditions[0].output = argv[PARAM_RESULTS];
 
-	// Output files for results
-	FILE *result_file[METRIC_SIZE] = {NULL};
-	char *str = new char[256];
-	for (int i=7; i<argc; i++) {
-		if (strcmp(argv[i], "PSNR") == 0) {
-			sprintf(str, "%s_psnr.csv", argv[PARAM_RESULTS]);
-			result_file[METRIC_PSNR] = fopen(str, "w");
+	bool metrics[METRIC_SIZE] = {false};
+	int nbthreads = ThreadPool::hardwareThreads();
+	int prefetch = 4;
+	int nbplanes = 1;
+	int bitdepth = 8;
+	int start = 0;
+	int end = nbframes-1;
+	int stride = 1;
+	bool stream = false;
+	int format = FORMAT_SPLIT;
+	bool maps = false;
+	bool intra = false;
+	int cache = 16;
+	bool maxbad = false;
+	QualityGate gate;
+	for (int i=PARAM_METRICS; i<argc; i++) {
+		if (strcmp(argv[i], "-threads") == 0 && i+1 < argc) {
+			nbthreads = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || nbthreads < 1) {
+				fprintf(stderr, "Incorrect value for number of threads: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-prefetch") == 0 && i+1 < argc) {
+			prefetch = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || prefetch < 0) {
+				fprintf(stderr, "Incorrect value for number of prefetched frames: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
 		}
-		else if (strcmp(argv[i], "SSIM") == 0) {
-			sprintf(str, "%s_ssim.csv", argv[PARAM_RESULTS]);
-			result_file[METRIC_SSIM] = fopen(str, "w");
+		else if (strcmp(argv[i], "-chroma") == 0) {
+			nbplanes = PLANE_SIZE;
 		}
-		else if (strcmp(argv[i], "MSSSIM") == 0) {
-			sprintf(str, "%s_msssim.csv", argv[PARAM_RESULTS]);
-			result_file[METRIC_MSSSIM] = fopen(str, "w");
+		else if (strcmp(argv[i], "-start") == 0 && i+1 < argc) {
+			start = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || start < 0) {
+				fprintf(stderr, "Incorrect value for first frame: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-end") == 0 && i+1 < argc) {
+			end = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || end < 0) {
+				fprintf(stderr, "Incorrect value for last frame: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-stride") == 0 && i+1 < argc) {
+			stride = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || stride < 1) {
+				fprintf(stderr, "Incorrect value for frame stride: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-bitdepth") == 0 && i+1 < argc) {
+			bitdepth = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || bitdepth < 8 || bitdepth > 16) {
+				fprintf(stderr, "Incorrect value for bit depth: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
 		}
-		else if (strcmp(argv[i], "VIFP") == 0) {
-			sprintf(str, "%s_vifp.csv", argv[PARAM_RESULTS]);
-			result_file[METRIC_VIFP] = fopen(str, "w");
+		else if (strcmp(argv[i], "-floor") == 0 && i+2 < argc) {
+			int m = findMetric(argv[++i]);
+			float value = strtof(argv[++i], &endptr);
+			if (m < 0 || *endptr) {
+				fprintf(stderr, "Incorrect frame threshold: %s %s\n", argv[i-1], argv[i]);
+				return EXIT_FAILURE;
+			}
+			gate.setFloor(m, value);
 		}
-		else if (strcmp(argv[i], "PSNRHVS") == 0) {
-			sprintf(str, "%s_psnrhvs.csv", argv[PARAM_RESULTS]);
-			result_file[METRIC_PSNRHVS] = fopen(str, "w");
+		else if (strcmp(argv[i], "-window") == 0 && i+3 < argc) {
+			int m = findMetric(argv[++i]);
+			int length = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			bool valid = m >= 0 && !*endptr && length > 0;
+			float value = strtof(argv[++i], &endptr);
+			if (!valid || *endptr) {
+				fprintf(stderr, "Incorrect window threshold: %s %s %s\n", argv[i-2], argv[i-1], argv[i]);
+				return EXIT_FAILURE;
+			}
+			gate.setWindow(m, length, value);
 		}
-		else if (strcmp(argv[i], "PSNRHVSM") == 0) {
-			sprintf(str, "%s_psnrhvsm.csv", argv[PARAM_RESULTS]);
-			result_file[METRIC_PSNRHVSM] = fopen(str, "w");
+		else if (strcmp(argv[i], "-maxbad") == 0 && i+1 < argc) {
+			int count = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || count < 0) {
+				fprintf(stderr, "Incorrect value for number of bad frames: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			gate.setMaxBad(count);
+			maxbad = true;
+		}
+		else if (strcmp(argv[i], "-format") == 0 && i+1 < argc) {
+			i++;
+			format = FORMAT_SIZE;
+			for (int f=0; f<FORMAT_SIZE; f++) {
+				if (strcmp(argv[i], FORMAT_NAME[f]) == 0) {
+					format = f;
+				}
+			}
+			if (format == FORMAT_SIZE) {
+				fprintf(stderr, "Incorrect value for output format: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-stream") == 0) {
+			stream = true;
+		}
+		else if (strcmp(argv[i], "-isa") == 0 && i+1 < argc) {
+			int isa = Simd::find(argv[++i]);
+			if (isa < 0) {
+				fprintf(stderr, "Incorrect value for instruction set: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+			if (!Simd::select(isa)) {
+				fprintf(stderr, "Instruction set not supported by this processor or build: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-maps") == 0) {
+			maps = true;
+		}
+		else if (strcmp(argv[i], "-intra") == 0) {
+			intra = true;
+		}
+		else if (strcmp(argv[i], "-cache") == 0 && i+1 < argc) {
+			cache = static_cast<int>(strtol(argv[++i], &endptr, 10));
+			if (*endptr || cache < 0) {
+				fprintf(stderr, "Incorrect value for cache size: %s\n", argv[i]);
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "-processed") == 0 && i+2 < argc) {
+			Rendition rendition;
+			rendition.path = argv[++i];
+			rendition.output = argv[++i];
+			renditions.push_back(rendition);
+		}
+		else {
+			int m = findMetric(argv[i]);
+			if (m >= 0) {
+				metrics[m] = true;
+			}
 		}
 	}
-	delete[] str;
 
-	// Check size for VIFp downsampling
-	if (result_file[METRIC_VIFP] != NULL && (height % 8 != 0 || width % 8 != 0)) {
-		fprintf(stderr, "VIFp: 'height' and 'width' have to be multiple of 8.\n");
-		exit(EXIT_FAILURE);
-	}
-	// Check size for MS-SSIM downsampling
-	if (result_file[METRIC_MSSSIM] != NULL && (height % 16 != 0 || width % 16 != 0)) {
-		fprintf(stderr, "MS-SSIM: 'height' and 'width' have to be multiple of 16.\n");
-		exit(EXIT_FAILURE);
+	// Frames are only bad below a floor
+	if (maxbad && !gate.hasFloor()) {
+		fprintf(stderr, "Maximum number of bad frames: -floor has to be given.\n");
+		return EXIT_FAILURE;
 	}
 
-	// Print header to file
+	// Identical frames are checked as if they differed by one in a single sample
+	gate.setMaxIndex(METRIC_PSNR, PSNR::maxIndex(height, width, bitdepth));
+
+	// Thresholds apply to computed metrics
 	for (int m=0; m<METRIC_SIZE; m++) {
-		if (result_file[m] != NULL) {
-			fprintf(result_file[m], "frame,value\n");
+		if (gate.hasThreshold(m) && !metrics[m]) {
+			fprintf(stderr, "Threshold on %s: the metric has to be computed.\n", METRIC_NAME[m]);
+			return EXIT_FAILURE;
 		}
 	}
 
-	PSNR *psnr     = new PSNR(height, width);
-	SSIM *ssim     = new SSIM(height, width);
-	MSSSIM *msssim = new MSSSIM(height, width);
-	VIFP *vifp     = new VIFP(height, width);
-	PSNRHVS *phvs  = new PSNRHVS(height, width);
+	if (maps && !metrics[METRIC_SSIM] && !metrics[METRIC_PSNRHVSM]) {
+		fprintf(stderr, "Maps: SSIM or PSNRHVSM has to be computed.\n");
+		return EXIT_FAILURE;
+	}
 
-	cv::Mat original_frame(height,width,CV_32F), processed_frame(height,width,CV_32F);
-	float result[METRIC_SIZE] = {0};
-	float result_avg[METRIC_SIZE] = {0};
+	// Frames start, start+stride, ... up to end (included) are computed
+	// Without a number of frames, streams are read until they end, or up to the last frame if given
+	if (stream && nbframes == 0) {
+		if (end >= 0 && start > end) {
+			fprintf(stderr, "Incorrect frame range: the last frame has to be after the first one.\n");
+			return EXIT_FAILURE;
+		}
+	}
+	else if (end >= nbframes || start > end) {
+		fprintf(stderr, "Incorrect frame range: the first and last frames have to be between 0 and %d.\n", nbframes-1);
+		return EXIT_FAILURE;
+	}
 
-	for (int frame=0; frame<nbframes; frame++) {
-		// Grab frame
-		if (!original->readOneFrame()) exit(EXIT_FAILURE);
-		original->getLuma(original_frame, CV_32F);
-		if (!processed->readOneFrame()) exit(EXIT_FAILURE);
-		processed->getLuma(processed_frame, CV_32F);
+	// Input video streams
+	VideoYUV *original  = new VideoYUV(argv[PARAM_ORIGINAL], height, width, nbframes, chroma, bitdepth);
+	for (size_t v=0; v<renditions.size(); v++) {
+		renditions[v].video = new VideoYUV(renditions[v].path, height, width, nbframes, chroma, bitdepth);
+	}
+
+	if (nbplanes > 1 && original->getHeight(PLANE_U) == 0) {
+		fprintf(stderr, "YUV400: no chroma components to compute the metrics on.\n");
+		exit(EXIT_FAILURE);
+	}
 
-		// Compute PSNR
-		if (result_file[METRIC_PSNR] != NULL) {
-			result[METRIC_PSNR] = psnr->compute(original_frame, processed_frame);
+	int plane_height[PLANE_SIZE];
+	int plane_width[PLANE_SIZE];
+	for (int p=0; p<nbplanes; p++) {
+		plane_height[p] = original->getHeight(p);
+		plane_width[p] = original->getWidth(p);
+		const char *error = Evaluator::checkSize(plane_height[p], plane_width[p], metrics);
+		if (error != NULL) {
+			fprintf(stderr, "%s%s.\n", p == PLANE_Y ? "" : "Chroma components: ", error);
+			exit(EXIT_FAILURE);
 		}
+	}
 
-		// Compute SSIM and MS-SSIM
-		if (result_file[METRIC_SSIM] != NULL && result_file[METRIC_MSSSIM] == NULL) {
-			result[METRIC_SSIM] = ssim->compute(original_frame, processed_frame);
+	// Output files for results, written in the background
+	// Streamed results are flushed as soon as they are written
+	std::vector<const char*> outputs;
+	for (size_t v=0; v<renditions.size(); v++) {
+		outputs.push_back(renditions[v].output);
+	}
+	ResultWriter *results = new ResultWriter(format, outputs, metrics, nbplanes, stream);
+
+	// Only the sampled frames are read, the others are skipped on disk
+	// Chroma samples are only read when needed
+	long range_end = end < 0 ? -1 : end+1;
+	original->setRange(start, range_end, stride);
+	original->setLumaOnly(nbplanes == 1);
+	for (size_t v=0; v<renditions.size(); v++) {
+		renditions[v].video->setRange(start, range_end, stride);
+		renditions[v].video->setLumaOnly(nbplanes == 1);
+	}
+
+	// Read all streams concurrently, ahead of the computation
+	if (prefetch > 0) {
+		original->prefetch(prefetch);
+		for (size_t v=0; v<renditions.size(); v++) {
+			renditions[v].video->prefetch(prefetch);
 		}
-		if (result_file[METRIC_MSSSIM] != NULL) {
-			msssim->compute(original_frame, processed_frame);
-			if (result_file[METRIC_SSIM] != NULL) {
-				result[METRIC_SSIM] = msssim->getSSIM();
+	}
+
+	// Hand the quality indexes to the writer and check them against the thresholds, in frame order
+	gate.start(static_cast<int>(renditions.size()), nbplanes);
+	bool gated = gate.isEnabled();
+	FrameEngine *engine = new FrameEngine(plane_height, plane_width, nbplanes, bitdepth,
+		static_cast<int>(renditions.size()), metrics, nbthreads,
+		[results, gated, &gate](int frame, int video, const float result[PLANE_SIZE][METRIC_SIZE], const float *map) {
+			results->write(frame, video, result, map);
+			if (gated) {
+				gate.check(frame, video, result);
 			}
-			result[METRIC_MSSSIM] = msssim->getMSSSIM();
-		}
+		});
+	// Streamed results are written as soon as they are computed
+	engine->setLive(stream);
+	engine->setIntra(intra);
+	engine->setCache(cache);
+	// Mapped frames are referred to by the slots in flight
+	original->setRetained(engine->getDepth());
+	for (size_t v=0; v<renditions.size(); v++) {
+		renditions[v].video->setRetained(engine->getDepth());
+	}
+	if (maps) {
+		MapLayout layout[MAP_SIZE];
+		engine->setMaps(true);
+		engine->getMapLayout(layout);
+		results->setMaps(layout);
+	}
+
+	// Time spent in each stage
+	Profile profile;
 
-		// Compute VIFp
-		if (result_file[METRIC_VIFP] != NULL) {
-			result[METRIC_VIFP] = vifp->compute(original_frame, processed_frame);
+	int nbsampled = 0;
+	int last = start;
+	for (int frame=start; end < 0 || frame<=end; frame+=stride) {
+		// The verdict of every processed video is decided, the frames in flight are still written out
+		if (gated && gate.allRejected()) {
+			break;
 		}
 
-		// Compute PSNR-HVS and PSNR-HVS-M
-		if (result_file[METRIC_PSNRHVS] != NULL || result_file[METRIC_PSNRHVSM] != NULL) {
-			phvs->compute(original_frame, processed_frame);
-			if (result_file[METRIC_PSNRHVS] != NULL) {
-				result[METRIC_PSNRHVS] = phvs->getPSNRHVS();
-			}
-			if (result_file[METRIC_PSNRHVSM] != NULL) {
-				result[METRIC_PSNRHVSM] = phvs->getPSNRHVSM();
+		// Grab frame, the shortest stream ends the computation
+		// The frames of rejected videos are not read nor compared anymore
+		double read_start = Profile::now();
+		bool ended = !readFrame(original, argv[PARAM_ORIGINAL], frame, stream);
+		for (size_t v=0; v<renditions.size() && !ended; v++) {
+			if (!gate.isRejected(static_cast<int>(v))) {
+				ended = !readFrame(renditions[v].video, renditions[v].path, frame, stream);
 			}
 		}
+		if (ended) {
+			break;
+		}
+		profile.record(STAGE_READ, Profile::now()-read_start);
+
+		FrameSlot *slot = engine->acquire(frame);
+		double copy_start = Profile::now();
 
-		// Print quality index to file
-		for (int m=0; m<METRIC_SIZE; m++) {
-			if (result_file[m] != NULL) {
-				result_avg[m] += result[m];
-				fprintf(result_file[m], "%d,%.6f\n", frame, static_cast<double>(result[m]));
+		for (size_t v=0; v<renditions.size(); v++) {
+			slot->processed[v].skipped = gate.isRejected(static_cast<int>(v));
+		}
+		// The conversion to floating-point, if needed, is done by the workers
+		// Mapped frames are computed in place, the others are copied out of the read buffers
+		for (int p=0; p<nbplanes; p++) {
+			if (!original->referPlane(p, slot->original[p])) {
+				original->getPlane(p, slot->original[p]);
+			}
+			for (size_t v=0; v<renditions.size(); v++) {
+				VideoYUV *video = renditions[v].video;
+				if (!slot->processed[v].skipped && !video->referPlane(p, slot->processed[v].component[p])) {
+					video->getPlane(p, slot->processed[v].component[p]);
+				}
 			}
 		}
+		profile.record(STAGE_COPY, Profile::now()-copy_start);
+
+		engine->submit(slot);
+		nbsampled++;
+		last = frame;
 	}
+	engine->flush();
+	engine->getProfile(profile);
+	delete engine;
 
 	// Print average quality index to file
-	for (int m=0; m<METRIC_SIZE; m++) {
-		if (result_file[m] != NULL) {
-			result_avg[m] /= static_cast<float>(nbframes);
-			fprintf(result_file[m], "average,%.6f", static_cast<double>(result_avg[m]));
-			fclose(result_file[m]);
-		}
+	results->close();
+	results->getProfile(profile);
+	delete results;
+
+	for (size_t v=0; v<renditions.size(); v++) {
+		delete renditions[v].video;
 	}
 
-	delete psnr;
-	delete ssim;
-	delete msssim;
-	delete vifp;
-	delete phvs;
 	delete original;
-	delete processed;
 
 	duration = static_cast<double>(cv::getTickCount())-duration;
 	duration /= cv::getTickFrequency();
+
+	// Print run report to file
+	char *report = new char[256];
+	sprintf(report, "%s_report.json", argv[PARAM_RESULTS]);
+	FILE *report_file = fopen(report, "w");
+	delete[] report;
+	if (report_file != NULL) {
+		fprintf(report_file, "{\n");
+		fprintf(report_file, "  \"videos\": %d,\n", static_cast<int>(renditions.size()));
+		fprintf(report_file, "  \"frames\": %d,\n  \"start\": %d,\n  \"end\": %d,\n  \"stride\": %d,\n", nbsampled, start, last, stride);
+		fprintf(report_file, "  \"height\": %d,\n  \"width\": %d,\n", height, width);
+		fprintf(report_file, "  \"planes\": %d,\n  \"bitdepth\": %d,\n", nbplanes, bitdepth);
+		fprintf(report_file, "  \"threads\": %d,\n  \"prefetch\": %d,\n", nbthreads, prefetch);
+		fprintf(report_file, "  \"stream\": %s,\n  \"format\": \"%s\",\n", stream ? "true" : "false", FORMAT_NAME[format]);
+		fprintf(report_file, "  \"maps\": %s,\n  \"isa\": \"%s\",\n", maps ? "true" : "false", Simd::name());
+		fprintf(report_file, "  \"intra\": %s,\n", intra ? "true" : "false");
+		fprintf(report_file, "  \"cache\": {\"size\": %d, \"hits\": %llu, \"misses\": %llu, \"identical\": %llu},\n", cache,
+			static_cast<unsigned long long>(profile.getCount(COUNTER_CACHE_HIT)),
+			static_cast<unsigned long long>(profile.getCount(COUNTER_CACHE_MISS)),
+			static_cast<unsigned long long>(profile.getCount(COUNTER_IDENTICAL)));
+		if (gated) {
+			fprintf(report_file, "  ");
+			gate.writeReport(report_file);
+			fprintf(report_file, ",\n");
+		}
+		fprintf(report_file, "  \"time\": %.6f,\n", duration);
+		fprintf(report_file, "  \"allocations\": %llu,\n", static_cast<unsigned long long>(profile.getAllocations()));
+		fprintf(report_file, "  \"stages\": ");
+		profile.write(report_file);
+		fprintf(report_file, "\n}\n");
+		fclose(report_file);
+	}
+
 	printf("Time: %0.3fs\n", duration);
 
+	if (gated) {
+		std::vector<const char*> paths;
+		for (size_t v=0; v<renditions.size(); v++) {
+			paths.push_back(renditions[v].path);
+		}
+		gate.writeSummary(stdout, METRIC_NAME, paths);
+		if (gate.isRejected()) {
+			return EXIT_REJECTED;
+		}
+	}
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,251 @@
+//
+// Copyright(c) Multimedia Signal Processing Group (MMSPG),
+//              Ecole Polytechnique Fédérale de Lausanne (EPFL)
+//              http://mmspg.epfl.ch
+// All rights reserved.
+// Author: Philippe Hanhart (philippe.hanhart@epfl.ch)
+//
+// Permission is hereby granted, without written agreement and without
+// license or royalty fees, to use, copy, modify, and distribute the
+// software provided and its documentation for research purpose only,
+// provided that this copyright notice and the original authors' names
+// appear on all copies and supporting documentation.
+// The software provided may not be commercially distributed.
+// In no event shall the Ecole Polytechnique Fédérale de Lausanne (EPFL)
+// be liable to any party for direct, indirect, special, incidental, or
+// consequential damages arising out of the use of the software and its
+// documentation.
+// The Ecole Polytechnique Fédérale de Lausanne (EPFL) specifically
+// disclaims any warranties.
+// The software provided hereunder is on an "as is" basis and the Ecole
+// Polytechnique Fédérale de Lausanne (EPFL) has no obligation to provide
+// maintenance, support, updates, enhancements, or modifications.
+//
+
+#include <deque>
+#include <vector>
+#include "vqmt.h"
+#include "FrameEngine.hpp"
+
+static_assert(static_cast<int>(VQMT_METRIC_SIZE) == static_cast<int>(METRIC_SIZE), "metrics of the API and of the Evaluator differ");
+static_assert(static_cast<int>(VQMT_PLANE_SIZE) == static_cast<int>(PLANE_SIZE), "planes of the API and of VideoYUV differ");
+
+struct vqmt_session {
+	vqmt_config config;
+	int nbplanes;
+	int height[PLANE_SIZE];
+	int width[PLANE_SIZE];
+	bool metrics[METRIC_SIZE];
+	FrameEngine *engine;
+	int next_frame;				// number of pushed frames
+	std::deque<vqmt_result> results;	// results written out by the engine, not pulled yet
+	std::vector<vqmt_result> sums;		// sum of the quality indexes of each processed video
+};
+
+// Dimensions of the components of a frame (0 for the chroma components of YUV400)
+static void planeSize(const vqmt_config *config, int height[PLANE_SIZE], int width[PLANE_SIZE])
+{
+	int h = config->height;
+	int w = config->width;
+	height[PLANE_Y] = h;
+	width[PLANE_Y] = w;
+	switch (config->chroma_format) {
+	case CHROMA_SUBSAMP_400:
+		h = w = 0;
+		break;
+	case CHROMA_SUBSAMP_420:
+		h >>= 1;
+		w >>= 1;
+		break;
+	case CHROMA_SUBSAMP_422:
+		w >>= 1;
+		break;
+	default:
+		break;
+	}
+	for (int p=PLANE_U; p<PLANE_SIZE; p++) {
+		height[p] = h;
+		width[p] = w;
+	}
+}
+
+static void resetResult(vqmt_result *result, int frame, int video)
+{
+	result->frame = frame;
+	result->video = video;
+	for (int p=0; p<PLANE_SIZE; p++) {
+		for (int m=0; m<METRIC_SIZE; m++) {
+			result->value[p][m] = 0.0f;
+		}
+	}
+}
+
+void vqmt_config_default(vqmt_config *config)
+{
+	config->height = 0;
+	config->width = 0;
+	config->chroma_format = CHROMA_SUBSAMP_420;
+	config->bitdepth = 8;
+	config->metrics = (1u << VQMT_METRIC_SIZE)-1;
+	config->chroma = 0;
+	config->videos = 1;
+	config->threads = 0;
+}
+
+const char* vqmt_config_check(const vqmt_config *config)
+{
+	if (config->height <= 0 || config->width <= 0) {
+		return "'height' and 'width' have to be positive";
+	}
+	if (config->chroma_format < CHROMA_SUBSAMP_400 || config->chroma_format > CHROMA_SUBSAMP_444) {
+		return "the chroma format has to be 0 (YUV400), 1 (YUV420), 2 (YUV422) or 3 (YUV444)";
+	}
+	if (config->chroma_format == CHROMA_SUBSAMP_420 && (config->height % 2 == 1 || config->width % 2 == 1)) {
+		return "YUV420: 'height' and 'width' have to be even numbers";
+	}
+	if (config->chroma_format == CHROMA_SUBSAMP_422 && config->width % 2 == 1) {
+		return "YUV422: 'width' has to be an even number";
+	}
+	if (config->bitdepth < 8 || config->bitdepth > 16) {
+		return "the bit depth has to be between 8 and 16";
+	}
+	if (config->metrics == 0 || config->metrics >= (1u << VQMT_METRIC_SIZE)) {
+		return "the mask of metrics has to select at least one known metric";
+	}
+	if (config->chroma && config->chroma_format == CHROMA_SUBSAMP_400) {
+		return "YUV400: no chroma components to compute the metrics on";
+	}
+	if (config->videos < 1 || config->threads < 0) {
+		return "the number of processed frames has to be positive, and the number of threads non-negative";
+	}
+
+	bool metrics[METRIC_SIZE];
+	for (int m=0; m<METRIC_SIZE; m++) {
+		metrics[m] = (config->metrics & (1u << m)) != 0;
+	}
+	int height[PLANE_SIZE];
+	int width[PLANE_SIZE];
+	planeSize(config, height, width);
+	int nbplanes = config->chroma ? PLANE_SIZE : 1;
+	for (int p=0; p<nbplanes; p++) {
+		const char *error = Evaluator::checkSize(height[p], width[p], metrics);
+		if (error != NULL) {
+			return error;
+		}
+	}
+	return NULL;
+}
+
+vqmt_session* vqmt_create(const vqmt_config *config)
+{
+	if (vqmt_config_check(config) != NULL) {
+		return NULL;
+	}
+
+	vqmt_session *session = new vqmt_session;
+	session->config = *config;
+	session->nbplanes = config->chroma ? PLANE_SIZE : 1;
+	planeSize(config, session->height, session->width);
+	for (int m=0; m<METRIC_SIZE; m++) {
+		session->metrics[m] = (config->metrics & (1u << m)) != 0;
+	}
+	session->next_frame = 0;
+	session->sums.resize(static_cast<size_t>(config->videos));
+	for (int v=0; v<config->videos; v++) {
+		resetResult(&session->sums[static_cast<size_t>(v)], 0, v);
+	}
+
+	int nbthreads = config->threads > 0 ? config->threads : ThreadPool::hardwareThreads();
+	session->engine = new FrameEngine(session->height, session->width, session->nbplanes, config->bitdepth,
+		config->videos, session->metrics, nbthreads,
+		[session](int frame, int video, const float value[PLANE_SIZE][METRIC_SIZE], const float *) {
+			vqmt_result result;
+			vqmt_result& sum = session->sums[static_cast<size_t>(video)];
+			resetResult(&result, frame, video);
+			for (int p=0; p<session->nbplanes; p++) {
+				for (int m=0; m<METRIC_SIZE; m++) {
+					if (session->metrics[m]) {
+						result.value[p][m] = value[p][m];
+						sum.value[p][m] += value[p][m];
+					}
+				}
+			}
+			sum.frame++;
+			session->results.push_back(result);
+		});
+	return session;
+}
+
+void vqmt_destroy(vqmt_session *session)
+{
+	if (session == NULL) {
+		return;
+	}
+	session->engine->flush();
+	delete session->engine;
+	delete session;
+}
+
+int vqmt_push(vqmt_session *session, const vqmt_frame *original, const vqmt_frame *processed)
+{
+	const vqmt_config& config = session->config;
+	for (int p=0; p<session->nbplanes; p++) {
+		if (original->plane[p] == NULL) {
+			return -1;
+		}
+		for (int v=0; v<config.videos; v++) {
+			if (processed[v].plane[p] == NULL) {
+				return -1;
+			}
+		}
+	}
+
+	// The slots point to the planes of the caller, which are read by the workers
+	int type = config.bitdepth > 8 ? CV_16UC1 : CV_8UC1;
+	FrameSlot *slot = session->engine->acquire(session->next_frame);
+	for (int p=0; p<session->nbplanes; p++) {
+		int h = session->height[p];
+		int w = session->width[p];
+		slot->original[p] = cv::Mat(h, w, type, const_cast<void*>(original->plane[p]), static_cast<size_t>(original->stride[p]));
+		for (int v=0; v<config.videos; v++) {
+			const vqmt_frame& frame = processed[v];
+			slot->processed[static_cast<size_t>(v)].component[p] = cv::Mat(h, w, type, const_cast<void*>(frame.plane[p]), static_cast<size_t>(frame.stride[p]));
+		}
+	}
+	session->engine->submit(slot);
+	session->next_frame++;
+	return 0;
+}
+
+int vqmt_pull(vqmt_session *session, vqmt_result *result)
+{
+	session->engine->poll();
+	if (session->results.empty()) {
+		return 0;
+	}
+	*result = session->results.front();
+	session->results.pop_front();
+	return 1;
+}
+
+void vqmt_flush(vqmt_session *session)
+{
+	session->engine->flush();
+}
+
+int vqmt_average(const vqmt_session *session, int video, vqmt_result *average)
+{
+	if (video < 0 || video >= session->config.videos) {
+		return -1;
+	}
+	const vqmt_result& sum = session->sums[static_cast<size_t>(video)];
+	*average = sum;
+	if (sum.frame > 0) {
+		for (int p=0; p<PLANE_SIZE; p++) {
+			for (int m=0; m<METRIC_SIZE; m++) {
+				average->value[p][m] /= static_cast<float>(sum.frame);
+			}
+		}
+	}
+	return 0;
+}